@@ -1,12 +1,76 @@
 #pragma once
+#include <array>
+#include <cstdint>
+#include <limits>
 #include <random>
 
-template <typename scalartype> class Randomizer
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+// 3"). The output is a pure function of (key, counter), so any number of
+// independent streams can be cut out of one seed without sharing state.
+class Philox4x32
 {
-    std::mt19937 gen;
+    std::array<uint32_t, 2> key;
+    std::array<uint32_t, 4> counter, block;
+    int used = 4;
+
+    static void Round(std::array<uint32_t, 4> &ctr,
+                      const std::array<uint32_t, 2> &k)
+    {
+        uint64_t p0 = (uint64_t)0xD2511F53 * ctr[0];
+        uint64_t p1 = (uint64_t)0xCD9E8D57 * ctr[2];
+
+        ctr = {{(uint32_t)(p1 >> 32) ^ ctr[1] ^ k[0], (uint32_t)p1,
+                (uint32_t)(p0 >> 32) ^ ctr[3] ^ k[1], (uint32_t)p0}};
+    }
+
+    void Generate()
+    {
+        auto k = key;
+        block = counter;
+
+        for (int i = 0; i < 10; i++)
+        {
+            Round(block, k);
+            k[0] += 0x9E3779B9;
+            k[1] += 0xBB67AE85;
+        }
+
+        if (++counter[0] == 0 && ++counter[1] == 0 && ++counter[2] == 0)
+            ++counter[3];
+        used = 0;
+    }
+
+  public:
+    typedef uint32_t result_type;
+
+    Philox4x32(uint64_t seed, uint64_t stream = 0)
+        : key{{(uint32_t)seed, (uint32_t)(seed >> 32)}},
+          counter{{0, 0, (uint32_t)stream, (uint32_t)(stream >> 32)}}
+    {
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max()
+    {
+        return std::numeric_limits<uint32_t>::max();
+    }
+
+    result_type operator()()
+    {
+        if (used == 4)
+            Generate();
+
+        return block[used++];
+    }
+};
+
+template <typename scalartype, typename engine = std::mt19937> class Randomizer
+{
+    engine gen;
 
   public:
-    Randomizer(uint32_t seed) { gen = std::mt19937(seed); }
+    Randomizer(uint32_t seed) : gen(seed) {}
+    Randomizer(engine gen) : gen(gen) {}
 
     scalartype RandomScalar(scalartype min, scalartype max)
     {
@@ -14,6 +78,12 @@ template <typename scalartype> class Randomizer
         return (scalartype)dis(gen);
     }
 
+    scalartype RandomNormal(scalartype mean, scalartype stddev)
+    {
+        std::normal_distribution<> dis(mean, stddev);
+        return (scalartype)dis(gen);
+    }
+
     uint32_t RandomInt(uint32_t min, uint32_t max)
     {
         if (min == max)
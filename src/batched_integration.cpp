@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <poll.h>
+
+#include "batched_integration.h"
+#include "latency_stats.h"
+
+using namespace std::chrono;
+using std::string;
+
+BatchedUdpTransport::BatchedUdpTransport(stringmap params, int cars)
+    : inbox(cars), outbox(cars), inbox_ready(cars, false),
+      outbox_ready(cars, false), identified(cars, false)
+{
+    int port = std::stoi(params["port"]);
+    int server_port = std::stoi(params["server_port"]);
+
+    auto address = TorcsIntegration::ResolveEndpoint(
+                       io_service, params["host"], server_port)
+                       .address();
+
+    handshake_retry =
+        std::chrono::microseconds(std::stoi(params["handshake_retry_us"]));
+    handshake_retry_max =
+        std::chrono::microseconds(std::stoi(params["handshake_retry_max_us"]));
+    handshake_timeout =
+        std::chrono::milliseconds(std::stoi(params["handshake_timeout_ms"]));
+
+    for (int i = 0; i < cars; i++)
+        servers.emplace_back(address, server_port + i);
+
+    socket = std::make_unique<udp::socket>(io_service,
+                                           udp::endpoint(udp::v4(), port));
+
+    int slots = cars * BATCH_SLOTS_PER_CAR;
+    recv_buffers.resize(slots * BATCH_SLOT_SIZE);
+    recv_iovecs.resize(slots);
+    recv_addrs.resize(slots);
+    recv_headers.resize(slots);
+    send_iovecs.resize(cars);
+    send_headers.resize(cars);
+
+    for (int i = 0; i < slots; i++)
+    {
+        recv_iovecs[i].iov_base = &recv_buffers[i * BATCH_SLOT_SIZE];
+        recv_iovecs[i].iov_len = BATCH_SLOT_SIZE;
+
+        memset(&recv_headers[i], 0, sizeof(mmsghdr));
+        recv_headers[i].msg_hdr.msg_name = &recv_addrs[i];
+        recv_headers[i].msg_hdr.msg_iov = &recv_iovecs[i];
+        recv_headers[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+int BatchedUdpTransport::Cars() { return servers.size(); }
+
+int BatchedUdpTransport::FindCar(const sockaddr_in &addr)
+{
+    for (int i = 0; i < servers.size(); i++)
+        if (ntohs(addr.sin_port) == servers[i].port())
+            return i;
+
+    return -1;
+}
+
+void BatchedUdpTransport::Handshake(string init_string)
+{
+    auto retry = handshake_retry;
+    auto deadline = steady_clock::now() + handshake_timeout;
+    pollfd fd{socket->native_handle(), POLLIN, 0};
+
+    auto left = [&]() {
+        return std::count(identified.begin(), identified.end(), false);
+    };
+
+    while (left() > 0)
+    {
+        if (handshake_timeout.count() > 0 && steady_clock::now() > deadline)
+            log_error("No answer from the simulator in " +
+                      std::to_string(handshake_timeout.count()) + " ms!");
+
+        for (int i = 0; i < Cars(); i++)
+            if (!identified[i])
+                Queue(i, init_string);
+
+        Flush();
+
+        auto whole = duration_cast<seconds>(retry);
+        timespec wait{(time_t)whole.count(),
+                      (long)duration_cast<nanoseconds>(retry - whole).count()};
+        ppoll(&fd, 1, &wait, nullptr);
+        retry = std::min(retry * 2, handshake_retry_max);
+
+        while (Drain(false) > 0)
+            ;
+    }
+}
+
+void BatchedUdpTransport::Queue(int car, string msg)
+{
+    outbox[car] = std::move(msg);
+    outbox_ready[car] = true;
+}
+
+string BatchedUdpTransport::Take(int car)
+{
+    Flush();
+
+    while (!inbox_ready[car])
+        Drain(true);
+
+    inbox_ready[car] = false;
+    return std::move(inbox[car]);
+}
+
+void BatchedUdpTransport::Flush()
+{
+    int count = 0, sent = 0;
+
+    for (int i = 0; i < Cars(); i++)
+    {
+        if (!outbox_ready[i])
+            continue;
+
+        send_iovecs[count].iov_base = &outbox[i][0];
+        send_iovecs[count].iov_len = outbox[i].size();
+
+        memset(&send_headers[count], 0, sizeof(mmsghdr));
+        send_headers[count].msg_hdr.msg_name = servers[i].data();
+        send_headers[count].msg_hdr.msg_namelen = servers[i].size();
+        send_headers[count].msg_hdr.msg_iov = &send_iovecs[count];
+        send_headers[count].msg_hdr.msg_iovlen = 1;
+
+        outbox_ready[i] = false;
+        count++;
+    }
+
+    while (sent < count)
+    {
+        int ret = sendmmsg(socket->native_handle(), &send_headers[sent],
+                           count - sent, 0);
+        send_calls++;
+
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            log_warning((string) "sendmmsg failed: " + strerror(errno));
+            return;
+        }
+
+        sent += ret;
+    }
+}
+
+int BatchedUdpTransport::Drain(bool wait)
+{
+    for (auto &header : recv_headers)
+        header.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+
+    int received =
+        recvmmsg(socket->native_handle(), recv_headers.data(),
+                 recv_headers.size(), wait ? MSG_WAITFORONE : MSG_DONTWAIT,
+                 nullptr);
+    receive_calls++;
+
+    if (received < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            log_warning((string) "recvmmsg failed: " + strerror(errno));
+
+        return 0;
+    }
+
+    for (int i = 0; i < received; i++)
+    {
+        int car = FindCar(recv_addrs[i]);
+
+        if (car < 0)
+            continue;
+
+        if (recv_headers[i].msg_hdr.msg_flags & MSG_TRUNC)
+            log_warning("Truncated datagram in the batched transport!");
+
+        if (!identified[car])
+        {
+            if (string(&recv_buffers[i * BATCH_SLOT_SIZE],
+                       recv_headers[i].msg_len) != "***identified***")
+            {
+                log_warning("Communication error on init!");
+                throw;
+            }
+
+            identified[car] = true;
+            continue;
+        }
+
+        // A newer state overwrites one the car hasn't picked up yet.
+        inbox[car].assign(&recv_buffers[i * BATCH_SLOT_SIZE],
+                          recv_headers[i].msg_len);
+        inbox_ready[car] = true;
+    }
+
+    return received;
+}
+
+BatchedTorcsIntegration::BatchedTorcsIntegration(
+    std::shared_ptr<BatchedUdpTransport> transport, int car)
+    : transport(transport), car(car)
+{
+}
+
+size_t BatchedUdpTransport::Prefault()
+{
+    // Written rather than read, the slots are still zero pages until then.
+    memset(recv_buffers.data(), 0, recv_buffers.size());
+
+    return recv_buffers.size();
+}
+
+CarState BatchedTorcsIntegration::Begin(stringmap params)
+{
+    transport->Handshake(TorcsIntegration::EncodeInitString(params));
+
+    string in_msg = transport->Take(car);
+
+    if (in_msg[0] == '*' && in_msg[1] == '*' && in_msg[2] == '*')
+    {
+        log_error("Unimplemented case!");
+        throw;
+    }
+
+    return TorcsIntegration::ParseCarState(in_msg);
+}
+
+CarState BatchedTorcsIntegration::Cycle(const CarSteers &steers)
+{
+    Submit(steers);
+    return Collect();
+}
+
+void BatchedTorcsIntegration::Submit(const CarSteers &steers)
+{
+    LatencyTimer timer(STAGE_ENCODE);
+    transport->Queue(car, TorcsIntegration::EncodeCarSteers(steers));
+}
+
+size_t BatchedTorcsIntegration::Prefault()
+{
+    return car == 0 ? transport->Prefault() : 0;
+}
+
+CarState BatchedTorcsIntegration::Collect()
+{
+    string in;
+
+    // Only the first car's flush sends anything, the rest time a no-op.
+    {
+        LatencyTimer timer(STAGE_SEND);
+        transport->Flush();
+    }
+
+    {
+        LatencyTimer timer(STAGE_RECEIVE);
+        in = transport->Take(car);
+    }
+
+    LatencyTimer timer(STAGE_PARSE);
+    return TorcsIntegration::ParseCarState(in);
+}
+
+BatchedTorcsIntegration::~BatchedTorcsIntegration() {}
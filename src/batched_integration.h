@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include <boost/asio.hpp>
+
+#include "car_io.h"
+#include "main.h"
+#include "torcs_integration.h"
+
+#define BATCH_SLOTS_PER_CAR 4
+#define BATCH_SLOT_SIZE 8192
+
+// One UDP socket shared by every car of a multi-car session. Car i talks to
+// server_port + i, replies queued by the cars go out in a single sendmmsg and
+// all ready states are drained with a single recvmmsg.
+class BatchedUdpTransport
+{
+    using udp = boost::asio::ip::udp;
+
+    boost::asio::io_service io_service;
+    std::unique_ptr<udp::socket> socket;
+    std::vector<udp::endpoint> servers;
+
+    std::vector<std::string> inbox, outbox;
+    std::vector<bool> inbox_ready, outbox_ready, identified;
+
+    std::chrono::microseconds handshake_retry, handshake_retry_max;
+    std::chrono::milliseconds handshake_timeout;
+
+    std::vector<char> recv_buffers;
+    std::vector<iovec> recv_iovecs, send_iovecs;
+    std::vector<sockaddr_in> recv_addrs;
+    std::vector<mmsghdr> recv_headers, send_headers;
+
+    int FindCar(const sockaddr_in &addr);
+
+  public:
+    uint64_t receive_calls = 0, send_calls = 0;
+
+    BatchedUdpTransport(stringmap params, int cars);
+
+    int Cars();
+    void Handshake(std::string init_string);
+
+    void Queue(int car, std::string msg);
+    std::string Take(int car);
+
+    void Flush();
+    int Drain(bool wait);
+
+    size_t Prefault();
+};
+
+class BatchedTorcsIntegration : public SimIntegration
+{
+    std::shared_ptr<BatchedUdpTransport> transport;
+    int car;
+
+  public:
+    virtual CarState Begin(stringmap driver_params) override;
+    virtual CarState Cycle(const CarSteers &) override;
+
+    virtual void Submit(const CarSteers &steers) override;
+    virtual CarState Collect() override;
+
+    // The transport is shared, only car 0 touches it.
+    virtual size_t Prefault() override;
+
+    BatchedTorcsIntegration(std::shared_ptr<BatchedUdpTransport> transport,
+                            int car);
+    virtual ~BatchedTorcsIntegration();
+};
@@ -0,0 +1,188 @@
+#include <cstdint>
+#include <cstring>
+
+#include "diagnostics.h"
+#include "utils.h"
+
+using std::string;
+
+#define DIAGNOSTICS_BUFFER (1 << 20)
+#define DIAGNOSTICS_MAGIC "HDIAG1\n"
+
+int DiagnosticsSink::Open(const string &name,
+                          const std::vector<string> &columns)
+{
+    for (int i = 0; i < channels.size(); i++)
+        if (channels[i].name == name)
+            return i;
+
+    channels.push_back({name, columns});
+    return channels.size() - 1;
+}
+
+std::shared_ptr<DiagnosticsSink> DiagnosticsSink::None()
+{
+    static auto none = std::make_shared<NullDiagnostics>();
+    return none;
+}
+
+std::shared_ptr<DiagnosticsSink> DiagnosticsSink::Create(string kind,
+                                                         string path)
+{
+    if (kind == "none")
+        return None();
+    else if (kind == "memory")
+        return std::make_shared<MemoryDiagnostics>();
+    else if (kind == "binary")
+        return std::make_shared<BinaryDiagnostics>(path + ".diag");
+    else if (kind == "csv")
+        return std::make_shared<CsvDiagnostics>(path);
+
+    log_warning("Unknown diagnostics sink " + kind + ", using none.");
+    return None();
+}
+
+// === Memory ===
+
+int MemoryDiagnostics::Open(const string &name,
+                            const std::vector<string> &columns)
+{
+    int id = DiagnosticsSink::Open(name, columns);
+    data.resize(channels.size());
+    return id;
+}
+
+void MemoryDiagnostics::Write(int channel, const float *values, int count)
+{
+    data[channel].insert(data[channel].end(), values, values + count);
+}
+
+const std::vector<float> &MemoryDiagnostics::Data(int channel)
+{
+    return data[channel];
+}
+
+// === Binary ===
+
+BinaryDiagnostics::BinaryDiagnostics(string filename)
+{
+    file = fopen(filename.c_str(), "wb");
+
+    if (file == nullptr)
+    {
+        log_warning("Couldn't open " + filename + " for diagnostics!");
+        return;
+    }
+
+    setvbuf(file, nullptr, _IOFBF, DIAGNOSTICS_BUFFER);
+    fwrite(DIAGNOSTICS_MAGIC, strlen(DIAGNOSTICS_MAGIC), 1, file);
+}
+
+BinaryDiagnostics::~BinaryDiagnostics()
+{
+    if (file != nullptr)
+        fclose(file);
+}
+
+static void put_string(FILE *file, const string &str)
+{
+    uint16_t size = str.size();
+    fwrite(&size, 2, 1, file);
+    fwrite(str.data(), size, 1, file);
+}
+
+int BinaryDiagnostics::Open(const string &name,
+                            const std::vector<string> &columns)
+{
+    int known = channels.size();
+    int id = DiagnosticsSink::Open(name, columns);
+
+    if (file == nullptr || id < known)
+        return id;
+
+    uint16_t id16 = id, count = columns.size();
+    fputc('C', file);
+    fwrite(&id16, 2, 1, file);
+    put_string(file, name);
+    fwrite(&count, 2, 1, file);
+    for (auto &column : columns)
+        put_string(file, column);
+
+    return id;
+}
+
+void BinaryDiagnostics::Write(int channel, const float *values, int count)
+{
+    if (file == nullptr)
+        return;
+
+    uint16_t id16 = channel, count16 = count;
+    fputc('R', file);
+    fwrite(&id16, 2, 1, file);
+    fwrite(&count16, 2, 1, file);
+    fwrite(values, sizeof(float), count, file);
+}
+
+void BinaryDiagnostics::Flush()
+{
+    if (file != nullptr)
+        fflush(file);
+}
+
+// === CSV ===
+
+CsvDiagnostics::CsvDiagnostics(string prefix) : prefix(prefix) {}
+
+CsvDiagnostics::~CsvDiagnostics()
+{
+    for (auto file : files)
+        if (file != nullptr)
+            fclose(file);
+}
+
+int CsvDiagnostics::Open(const string &name,
+                         const std::vector<string> &columns)
+{
+    int known = channels.size();
+    int id = DiagnosticsSink::Open(name, columns);
+
+    if (id < known)
+        return id;
+
+    string filename = prefix + "_" + name + ".csv";
+    FILE *file = fopen(filename.c_str(), "w");
+
+    if (file == nullptr)
+    {
+        log_warning("Couldn't open " + filename + " for diagnostics!");
+    }
+    else
+    {
+        setvbuf(file, nullptr, _IOFBF, DIAGNOSTICS_BUFFER);
+        for (int i = 0; i < columns.size(); i++)
+            fprintf(file, i == 0 ? "%s" : ",%s", columns[i].c_str());
+        fputc('\n', file);
+    }
+
+    files.push_back(file);
+    return id;
+}
+
+void CsvDiagnostics::Write(int channel, const float *values, int count)
+{
+    FILE *file = files[channel];
+
+    if (file == nullptr)
+        return;
+
+    for (int i = 0; i < count; i++)
+        fprintf(file, i == 0 ? "%g" : ",%g", values[i]);
+    fputc('\n', file);
+}
+
+void CsvDiagnostics::Flush()
+{
+    for (auto file : files)
+        if (file != nullptr)
+            fflush(file);
+}
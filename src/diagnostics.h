@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdio>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Where tables of float diagnostics go. Producers open a channel once and
+// then write rows of its columns; with the "none" sink Enabled() is false
+// and they shouldn't even compute them. Sinks aren't thread safe, each
+// thread that writes needs its own.
+class DiagnosticsSink
+{
+  protected:
+    struct Channel
+    {
+        std::string name;
+        std::vector<std::string> columns;
+    };
+
+    std::vector<Channel> channels;
+
+  public:
+    virtual ~DiagnosticsSink() {}
+
+    virtual bool Enabled() { return true; }
+
+    // Reopening a channel by name returns the id it already has.
+    virtual int Open(const std::string &name,
+                     const std::vector<std::string> &columns);
+    virtual void Write(int channel, const float *values, int count) = 0;
+    virtual void Flush() {}
+
+    void Write(int channel, std::initializer_list<float> values)
+    {
+        Write(channel, values.begin(), values.size());
+    }
+
+    // kind is none, memory, binary or csv. Files are named after path: the
+    // binary sink writes <path>.diag, the csv one <path>_<channel>.csv.
+    static std::shared_ptr<DiagnosticsSink> Create(std::string kind,
+                                                   std::string path);
+    static std::shared_ptr<DiagnosticsSink> None();
+};
+
+class NullDiagnostics : public DiagnosticsSink
+{
+  public:
+    virtual bool Enabled() override { return false; }
+    virtual int Open(const std::string &name,
+                     const std::vector<std::string> &columns) override
+    {
+        return 0;
+    }
+    virtual void Write(int channel, const float *values, int count) override
+    {
+    }
+};
+
+// Keeps every row, for tools that inspect diagnostics in-process.
+class MemoryDiagnostics : public DiagnosticsSink
+{
+    std::vector<std::vector<float>> data;
+
+  public:
+    virtual int Open(const std::string &name,
+                     const std::vector<std::string> &columns) override;
+    virtual void Write(int channel, const float *values, int count) override;
+
+    const std::vector<float> &Data(int channel);
+};
+
+// Length-prefixed records through a large stdio buffer: channel definitions
+// ('C') followed by raw float rows ('R').
+class BinaryDiagnostics : public DiagnosticsSink
+{
+    FILE *file;
+
+  public:
+    BinaryDiagnostics(std::string filename);
+    virtual ~BinaryDiagnostics();
+
+    virtual int Open(const std::string &name,
+                     const std::vector<std::string> &columns) override;
+    virtual void Write(int channel, const float *values, int count) override;
+    virtual void Flush() override;
+};
+
+class CsvDiagnostics : public DiagnosticsSink
+{
+    std::string prefix;
+    std::vector<FILE *> files;
+
+  public:
+    CsvDiagnostics(std::string prefix);
+    virtual ~CsvDiagnostics();
+
+    virtual int Open(const std::string &name,
+                     const std::vector<std::string> &columns) override;
+    virtual void Write(int channel, const float *values, int count) override;
+    virtual void Flush() override;
+};
@@ -1,18 +1,30 @@
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 
+#include <unistd.h>
+
 #include "driver.h"
+#include "latency_stats.h"
+#include "logger.h"
+#include "realtime.h"
+#include "track_store.h"
 
 using std::string;
 using std::fstream;
 using std::ios;
 
-HingyDriver::HingyDriver(stringmap params) : Driver(params)
+HingyDriver::HingyDriver(stringmap params,
+                         std::shared_ptr<const TrackIndex> track_index)
+    : HingyDriver(params, PrepareTrack(params), track_index)
 {
-    bool gui = std::stoi(params["gui"]);
-    bool record = std::stoi(params["stage"]) == 0;
+}
 
-    float force1 = std::stof(params["force1"]);
-    float force2 = std::stof(params["force2"]);
+HingyDriver::HingyDriver(stringmap params, std::shared_ptr<HingyTrack> track,
+                         std::shared_ptr<const TrackIndex> track_index)
+    : Driver(params), track(track), params(params)
+{
+    bool gui = std::stoi(params["gui"]);
 
     float sa = std::stof(params["sa"]);
     float sb = std::stof(params["sb"]);
@@ -24,12 +36,90 @@ HingyDriver::HingyDriver(stringmap params) : Driver(params)
     speed_factor = std::stof(params["speed_factor"]);
     speed_base = std::stof(params["speed_base"]);
 
+    snapshot_cycles = std::stoi(params["snapshot_cycles"]);
+
+    diagnostics = track->GetDiagnostics();
+    if (diagnostics->Enabled())
+        diagnostics_channel = diagnostics->Open(
+            "driver", {"odometer", "cross_position", "speed_x", "target_speed",
+                       "steering", "gas", "brake", "gear"});
+
+    if (params["track"] == "auto")
+    {
+        this->track_index =
+            track_index ? track_index : OpenTrackIndex(params);
+    }
+    else if (!track->Recording())
+    {
+        track->ConstructSpeeds(sa, sb, sc);
+        track->Snapshot("speeds", 0);
+        if (gui)
+            std::static_pointer_cast<HingyTrackGui>(track)->PublishFrame();
+    }
+
+    cross_position_control = PidController(-0.24f, -0.0f, 0.0f, 1.0f);
+    angle_control = PidController(-2.0f, -0.0f, 0.0f, 1.0f);
+}
+
+std::shared_ptr<const TrackIndex> HingyDriver::OpenTrackIndex(stringmap params)
+{
+    auto track_index = std::make_shared<TrackIndex>(
+        TrackIndex::Open(params["track_dir"], params["track_index"],
+                         std::stoi(params["threads"])));
+
+    if (track_index->Size() == 0)
+        log_error("No tracks to identify this one among in " +
+                  params["track_dir"] + "!");
+
+    log_info("Identifying the track among " +
+             std::to_string(track_index->Size()) + " in " +
+             params["track_dir"]);
+    return track_index;
+}
+
+std::shared_ptr<HingyTrack> HingyDriver::PrepareTrack(stringmap params)
+{
+    std::shared_ptr<HingyTrack> track;
+    bool gui = std::stoi(params["gui"]);
+    bool record = std::stoi(params["stage"]) == 0;
+
+    // Picked once the car has driven a bit, see IdentifyTrack().
+    if (params["track"] == "auto")
+        return std::make_shared<HingyTrack>("");
+
+    float force1 = std::stof(params["force1"]);
+    float force2 = std::stof(params["force2"]);
+
     int hinges_iterations = atoi(params["hinges_iterations"].c_str());
+    float hinges_tolerance = std::stof(params["hinges_tolerance"]);
+    int snapshot_every = std::stoi(params["snapshot_every"]);
+
+    // Diagnostics are there to watch the track being built, which attaching
+    // to a shared or preprocessed one skips.
+    string key = !record && params["diagnostics"] == "none"
+                     ? TrackStore::Key(params)
+                     : "";
+    string shared = std::stoi(params["track_store"]) ? key : "";
 
     if (gui)
-        track = std::make_shared<HingyTrackGui>(params["track"], 1000, 1000);
+        track = std::make_shared<HingyTrackGui>(
+            params["track"], 1000, 1000, std::stoi(params["gui_fps"]), shared);
     else
-        track = std::make_shared<HingyTrack>(params["track"]);
+        track = std::make_shared<HingyTrack>(params["track"], shared);
+
+    // Named after the process and the car, so bots and cars writing to the
+    // same directory don't truncate each other's files.
+    string car = params["car"] == "" ? "0" : params["car"];
+    track->SetDiagnostics(DiagnosticsSink::Create(
+        params["diagnostics"], params["diagnostics_out"] + "_" +
+                                   std::to_string(getpid()) + "_car" + car));
+
+    if (params["snapshots"] != "")
+    {
+        int size = std::stoi(params["snapshot_size"]);
+        track->AttachSnapshots(
+            std::make_shared<TrackSnapshots>(params["snapshots"], size, size));
+    }
 
     if (!record)
     {
@@ -39,34 +129,93 @@ HingyDriver::HingyDriver(stringmap params) : Driver(params)
             throw;
         }
 
-        track->ConstructBounds();
-        track->ConstructHinges(13);
+        if (track->Shared())
+        {
+            log_info("Attached the shared track " + key);
+            return track;
+        }
+
+        string artifact =
+            key != "" ? params["prep_dir"] + "/" + TrackStore::ArtifactName(key)
+                      : "";
+        if (artifact != "" && track->AttachShared(TrackStore::Load(artifact)))
+        {
+            log_info("Loaded the preprocessed track " + artifact);
+            if (shared != "")
+                track->PublishShared(shared);
+            return track;
+        }
 
-        if (!track->LoadHingesFromCache())
+        track->ConstructBounds();
+        track->ConstructHinges(HINGE_SKIP);
+
+        // Relaxed from the cached hinges of the nearest forces when there are
+        // any, only until they settle, so sweeping forces doesn't pay for a
+        // cold relaxation per candidate.
+        bool exact = false;
+        bool warm = track->LoadHingesFromCache(force1, force2, exact);
+
+        // An edited track only needs relaxing around the edit.
+        HingyTrack::Patch patch;
+        bool patched = !warm &&
+                       track->PatchHingesFromCache(force1, force2,
+                                                   hinges_iterations,
+                                                   hinges_tolerance, patch);
+        if (patched)
+        {
+            log_info("Track edited at waypoint " +
+                     std::to_string(patch.first_waypoint) + " (" +
+                     std::to_string(patch.old_waypoints) + " -> " +
+                     std::to_string(patch.new_waypoints) +
+                     " waypoints), relaxed " + std::to_string(patch.relaxed) +
+                     " hinges for " + std::to_string(patch.iterations) +
+                     " iterations");
+            track->CacheHinges(force1, force2);
+        }
+        else if (!exact)
         {
-            for (int i = 0; i < hinges_iterations; i++)
+            int i = 0;
+            for (; i < hinges_iterations; i++)
             {
                 track->SimulateHinges(force1, force2);
                 if (gui && i % 1000 == 0)
                     std::static_pointer_cast<HingyTrackGui>(track)
-                        ->TickGraphics();
+                        ->PublishFrame();
+                if (snapshot_every > 0 && i % snapshot_every == 0)
+                    track->Snapshot("hinges", i);
+                if (warm && track->HingesSettled(hinges_tolerance))
+                    break;
             }
 
-            track->CacheHinges();
+            if (warm)
+                log_info("Hinges warm started, settled after " +
+                         std::to_string(std::min(i + 1, hinges_iterations)) +
+                         " iterations");
+            track->CacheHinges(force1, force2);
         }
         track->SimulateHinges(force1, force2);
 
-        track->ConstructSpeeds(sa, sb, sc);
-        if (gui)
-            std::static_pointer_cast<HingyTrackGui>(track)->TickGraphics();
+        // Published with the speed profile these parameters give, drivers
+        // constructed with others copy the hinges before changing it.
+        if (shared != "")
+        {
+            track->ConstructSpeeds(std::stof(params["sa"]),
+                                   std::stof(params["sb"]),
+                                   std::stof(params["sc"]));
+            if (track->PublishShared(shared))
+                log_info("Published the track as " + shared);
+            else
+                track->AttachShared(shared);
+        }
     }
     else
     {
-        track->BeginRecording();
+        track->BeginRecording(std::stoi(params["record_laps"]),
+                              std::stoi(params["threads"]),
+                              std::stof(params["record_tolerance"]));
     }
 
-    cross_position_control = PidController(-0.24f, -0.0f, 0.0f, 1.0f);
-    angle_control = PidController(-2.0f, -0.0f, 0.0f, 1.0f);
+    return track;
 }
 
 void HingyDriver::Cycle(CarSteers &steers, const CarState &state)
@@ -77,15 +226,23 @@ void HingyDriver::Cycle(CarSteers &steers, const CarState &state)
     last_dt = dt;
     last_timestamp = state.current_lap_time;
 
+    float angle = (state.wheels_speeds[0] - state.wheels_speeds[1]) * -dt;
+    if (track_index)
+        IdentifyTrack(state, angle);
+
     if (state.speed_x < 20.0f)
     {
         cross_position_control.AntiWindup();
         angle_control.AntiWindup();
     }
 
-    auto hinge_data = track->GetHingePosAndHeading(state.absolute_odometer);
-    auto hinge_data_next = track->GetHingePosAndHeading(
-        state.absolute_odometer + track->hinge_sep / 4.0f);
+    std::pair<float, float> hinge_data, hinge_data_next;
+    {
+        LatencyTimer timer(STAGE_TRACK);
+        hinge_data = track->GetHingePosAndHeading(state.absolute_odometer);
+        hinge_data_next = track->GetHingePosAndHeading(
+            state.absolute_odometer + track->hinge_sep / 4.0f);
+    }
     hinge_data.second = (hinge_data.second + hinge_data_next.second) / 2.0f;
 
     float master_out = cross_position_control.Update(hinge_data.first * 0.95f,
@@ -95,9 +252,12 @@ void HingyDriver::Cycle(CarSteers &steers, const CarState &state)
         hinge_data.second - master_output_factor * master_out,
         steering_factor * state.angle, dt);
 
-    track->MarkWaypoint(
-        state.absolute_odometer, state.cross_position, -state.cross_position,
-        (state.wheels_speeds[0] - state.wheels_speeds[1]) * -dt, state.speed_x);
+    track->MarkWaypoint(state.absolute_odometer, state.cross_position,
+                        -state.cross_position, angle, state.speed_x);
+
+    if (snapshot_cycles > 0 && cycles % snapshot_cycles == 0)
+        track->Snapshot("cycle", cycles);
+    cycles++;
 
     float target_speed = std::min(GetTargetSpeed(state), GetTargetSpeed(state));
 
@@ -118,8 +278,17 @@ void HingyDriver::Cycle(CarSteers &steers, const CarState &state)
         steering_enabled = true;
     }
 
-    if (std::abs(state.angle) > HALF_PI ||
-        (std::abs(state.cross_position) > 1.0f && state.speed_x < 5.0f))
+    bool recovering =
+        std::abs(state.angle) > HALF_PI ||
+        (std::abs(state.cross_position) > 1.0f && state.speed_x < 5.0f);
+
+    if (recovering != reversing)
+        LOG_INFO("%s at %.1f m, track position %.2f, angle %.2f",
+                 recovering ? "Reversing" : "Back on track",
+                 state.absolute_odometer, state.cross_position, state.angle);
+    reversing = recovering;
+
+    if (recovering)
         SetReverseGear(state, steers);
     else
         SetClutchAndGear(state, steers);
@@ -131,6 +300,120 @@ void HingyDriver::Cycle(CarSteers &steers, const CarState &state)
 
     if (!steering_enabled)
         steers.steering_wheel = 0.0f;
+
+    if (diagnostics->Enabled())
+        diagnostics->Write(diagnostics_channel,
+                           {state.absolute_odometer, state.cross_position,
+                            state.speed_x, target_speed, steers.steering_wheel,
+                            steers.gas, steers.hand_brake, (float)steers.gear});
+
+    if (telemetry)
+        telemetry->Publish(
+            {(uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now().time_since_epoch())
+                 .count(),
+             telemetry_car, track->CurrentHinge(), state.absolute_odometer,
+             hinge_data.first, hinge_data.second, steers.steering_wheel,
+             steers.gas, target_speed});
+}
+
+void HingyDriver::IdentifyTrack(const CarState &state, float angle)
+{
+    if (picked_track.valid())
+    {
+        if (picked_track.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready)
+            return;
+
+        track = picked_track.get();
+        track->ConstructSpeeds(std::stof(params["sa"]), std::stof(params["sb"]),
+                               std::stof(params["sc"]));
+        picked_track = {};
+        track_index.reset();
+        log_info("Switched to " + params["track"]);
+        return;
+    }
+
+    observation.Add(state.absolute_odometer, angle);
+    if (observation.Distance() < std::stof(params["auto_track_distance"]) ||
+        observation.turns.size() == observed_samples)
+        return;
+    observed_samples = observation.turns.size();
+
+    auto start = std::chrono::steady_clock::now();
+    TrackIndex::Match match = track_index->Find(observation);
+    float us = std::chrono::duration<float, std::micro>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+
+    // Not sure yet, it's given up to three times the distance to become so.
+    bool sure = match.track >= 0 &&
+                match.distance * TRACK_INDEX_MARGIN < match.runner_up;
+    if (!sure && observation.Distance() <
+                     3.0f * std::stof(params["auto_track_distance"]))
+        return;
+
+    // The index isn't empty, see OpenTrackIndex().
+    if (match.track < 0)
+        log_error("Couldn't match the track against the index!");
+
+    params["track"] = track_index->File(match.track);
+    LOG_INFO("%s %s after %.0f m in %.0f us, off by %g, the next best by %g",
+             sure ? "Identified" : "Guessing", params["track"],
+             observation.Distance(), us, match.distance, match.runner_up);
+    if (!sure)
+        log_warning("No track matched clearly, going with the closest");
+
+    auto prepare = [params = params]() {
+        leave_realtime();
+        return PrepareTrack(params);
+    };
+    picked_track = std::async(std::launch::async, prepare).share();
+}
+
+void HingyDriver::SetTelemetry(std::shared_ptr<TelemetryHub> telemetry,
+                               int car)
+{
+    this->telemetry = telemetry;
+    telemetry_car = car;
+}
+
+size_t HingyDriver::Prefault() { return track->Prefault(); }
+
+void HingyDriver::WarmUp(int cycles)
+{
+    // A copy of a recording track shares its simplifier and would save its
+    // waypoints over the track file, so there's nothing to warm up then.
+    if (track->Recording())
+    {
+        log_info("Not warming up while recording");
+        return;
+    }
+
+    HingyDriver scratch(*this);
+    scratch.track = std::make_shared<HingyTrack>(*track);
+    scratch.track->AttachSnapshots(nullptr);
+    scratch.track->SetDiagnostics(DiagnosticsSink::None());
+    scratch.diagnostics = DiagnosticsSink::None();
+    scratch.telemetry.reset();
+    scratch.snapshot_cycles = 0;
+    scratch.track_index.reset();
+    scratch.picked_track = {};
+
+    CarState state;
+    CarSteers steers;
+    state.speed_x = 100.0f;
+    state.rpm = 7000.0f;
+    state.gear = 3.0f;
+    state.wheels_speeds.fill(state.speed_x / 3.6f / 0.33f);
+    state.sensors.fill(200.0f);
+
+    for (int i = 0; i < cycles; i++)
+    {
+        scratch.Cycle(steers, state);
+        state.absolute_odometer += state.speed_x / 3.6f * 0.02f;
+        state.current_lap_time += 0.02f;
+    }
 }
 
 void HingyDriver::SetReverseGear(const CarState &state, CarSteers &steers)
@@ -185,7 +468,7 @@ float HingyDriver::GetTargetSpeed(const CarState &state)
 {
     float agent_speed;
 
-    if (track->Recording())
+    if (track->Recording() || track_index)
         return 45.0f;
 
     float hs = track->GetHingeSpeed();
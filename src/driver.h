@@ -1,11 +1,14 @@
 #pragma once
 
+#include <future>
 #include <memory>
 
 #include "car_io.h"
 #include "hingy_track.h"
 #include "main.h"
 #include "pid_controller.h"
+#include "telemetry.h"
+#include "track_index.h"
 
 class Driver
 {
@@ -21,15 +24,28 @@ class HingyDriver : public Driver
 {
   private:
     std::shared_ptr<HingyTrack> track;
+    std::shared_ptr<DiagnosticsSink> diagnostics;
+    int diagnostics_channel = 0;
+    std::shared_ptr<TelemetryHub> telemetry;
+    int telemetry_car = 0;
     float last_timestamp = 0.0f, speed_factor, speed_base;
     float last_dt = 0.0f, last_rpm = 0.0f;
     float master_output_factor, steering_factor;
     int gear_dir;
+    int cycles = 0, snapshot_cycles;
     float stuck_counter;
-    bool steering_enabled = false;
+    bool steering_enabled = false, reversing = false;
 
     std::vector<float> grn_inputs;
 
+    // Set while track:auto is still working out which track it's on, it
+    // drives on an empty one meanwhile.
+    stringmap params;
+    std::shared_ptr<const TrackIndex> track_index;
+    TrackObservation observation;
+    size_t observed_samples = 0;
+    std::shared_future<std::shared_ptr<HingyTrack>> picked_track;
+
     PidController cross_position_control;
     PidController angle_control;
     PidController speed_control;
@@ -37,13 +53,36 @@ class HingyDriver : public Driver
     void SetClutchAndGear(const CarState &state, CarSteers &steers);
     void SetReverseGear(const CarState &state, CarSteers &steers);
     void StuckOverride(CarSteers &steers, const CarState &state, float dt);
+    // Matches what's been driven so far against the index, then prepares
+    // the track it matched in the background and switches to it once ready.
+    void IdentifyTrack(const CarState &state, float angle);
 
     float GetTargetSpeed(const CarState &state);
 
   public:
-    HingyDriver(stringmap params);
+    // With track:auto, the track is identified among those in the index,
+    // opened here when none is given.
+    HingyDriver(stringmap params,
+                std::shared_ptr<const TrackIndex> track_index = nullptr);
+    HingyDriver(stringmap params, std::shared_ptr<HingyTrack> track,
+                std::shared_ptr<const TrackIndex> track_index = nullptr);
     virtual ~HingyDriver();
 
+    // Loads the track and relaxes its hinges, everything up to the speed
+    // profile, which depends on the driver's own parameters.
+    static std::shared_ptr<HingyTrack> PrepareTrack(stringmap params);
+    // The index of the tracks in track_dir, once for all the cars.
+    static std::shared_ptr<const TrackIndex> OpenTrackIndex(stringmap params);
+
     virtual void Cycle(CarSteers &steers, const CarState &state);
     virtual stringmap GetSimulatorInitParameters();
+
+    // Publishes every cycle to the hub, tagged with the given car.
+    void SetTelemetry(std::shared_ptr<TelemetryHub> telemetry, int car);
+
+    size_t Prefault();
+    // Runs the given number of cycles on synthetic states, through a scratch
+    // copy of the driver and its track so none of their state changes.
+    // Skipped while the track is recording.
+    void WarmUp(int cycles);
 };
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "flight_recorder.h"
+#include "utils.h"
+
+using std::string;
+
+#define FLIGHT_POLL_MS 100
+
+FlightRecorder *FlightRecorder::active = nullptr;
+std::atomic<bool> FlightRecorder::dump_requested{false};
+
+static FlightHeader make_header(uint64_t count)
+{
+    FlightHeader header;
+
+    memcpy(header.magic, FLIGHT_MAGIC, 8);
+    header.version = FLIGHT_VERSION;
+    header.record_size = sizeof(FlightRecord);
+    header.state_size = sizeof(CarState);
+    header.steers_size = sizeof(CarSteers);
+    header.count = count;
+
+    return header;
+}
+
+FlightRecorder::FlightRecorder(string filename, int records)
+    : ring(std::max(records, 1)), start_time(std::chrono::steady_clock::now()),
+      filename(filename), crash_filename(filename + ".crash")
+{
+    // Touch the whole ring now rather than page by page in the loop.
+    memset(ring.data(), 0, ring.size() * sizeof(FlightRecord));
+
+    // exit() from anywhere, the simulator's shutdown included, still ends
+    // with a dump.
+    static bool registered = false;
+    if (!registered)
+        std::atexit([]() {
+            if (active != nullptr)
+                active->Stop();
+        });
+    registered = true;
+
+    active = this;
+    signal(SIGUSR1, OnDumpSignal);
+    for (int sig : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT})
+        signal(sig, OnCrashSignal);
+
+    writer = std::thread(&FlightRecorder::WriterLoop, this);
+}
+
+FlightRecorder::~FlightRecorder() { Stop(); }
+
+void FlightRecorder::OnDumpSignal(int) { dump_requested = true; }
+
+// Only async-signal-safe calls from here on. The thread that crashed was
+// most likely the one recording, so the ring is taken as it is.
+void FlightRecorder::OnCrashSignal(int sig)
+{
+    FlightRecorder *recorder = active;
+
+    if (recorder != nullptr)
+    {
+        uint64_t end = recorder->head.load();
+        uint64_t size = recorder->ring.size();
+        uint64_t count = end < size ? end : size;
+        uint64_t first = (end - count) % size;
+        FlightHeader header = make_header(count);
+
+        int fd = open(recorder->crash_filename.c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0)
+        {
+            auto data = (const char *)recorder->ring.data();
+            uint64_t tail = std::min(count, size - first);
+
+            write(fd, &header, sizeof(header));
+            write(fd, data + first * sizeof(FlightRecord),
+                  tail * sizeof(FlightRecord));
+            write(fd, data, (count - tail) * sizeof(FlightRecord));
+            close(fd);
+        }
+    }
+
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+bool FlightRecorder::WriteFile()
+{
+    uint64_t size = ring.size();
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t begin = end > size ? end - size : 0;
+    std::vector<FlightRecord> copy;
+
+    copy.reserve(end - begin);
+    for (uint64_t i = begin; i < end; i++)
+        copy.push_back(ring[i % size]);
+
+    // Whatever the loop wrote meanwhile may have overwritten the oldest
+    // records copied, including the slot it's writing right now.
+    uint64_t now = head.load(std::memory_order_acquire);
+    uint64_t valid = now + 1 > size ? now + 1 - size : 0;
+    size_t skip = valid > begin ? std::min<uint64_t>(valid - begin, copy.size())
+                                : 0;
+
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (f == nullptr)
+        return false;
+
+    FlightHeader header = make_header(copy.size() - skip);
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(copy.data() + skip, sizeof(FlightRecord), copy.size() - skip, f);
+
+    return fclose(f) == 0;
+}
+
+void FlightRecorder::WriterLoop()
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    while (!stop)
+    {
+        wakeup.wait_for(guard, std::chrono::milliseconds(FLIGHT_POLL_MS));
+
+        if (dump_requested.exchange(false) && !WriteFile())
+            log_warning("Couldn't write the flight recording to " + filename +
+                        "!");
+    }
+}
+
+void FlightRecorder::Dump()
+{
+    dump_requested = true;
+    wakeup.notify_one();
+}
+
+void FlightRecorder::Stop()
+{
+    if (!writer.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+
+    wakeup.notify_one();
+    writer.join();
+
+    if (!WriteFile())
+        log_warning("Couldn't write the flight recording to " + filename + "!");
+
+    active = nullptr;
+}
+
+bool FlightRecorder::Load(string filename, std::vector<FlightRecord> &out)
+{
+    FlightHeader header;
+    FILE *f = fopen(filename.c_str(), "rb");
+
+    if (f == nullptr)
+        return false;
+
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, FLIGHT_MAGIC, 8) != 0 ||
+        header.version != FLIGHT_VERSION ||
+        header.record_size != sizeof(FlightRecord) ||
+        header.state_size != sizeof(CarState) ||
+        header.steers_size != sizeof(CarSteers))
+    {
+        fclose(f);
+        return false;
+    }
+
+    out.resize(header.count);
+    size_t read = fread(out.data(), sizeof(FlightRecord), header.count, f);
+    fclose(f);
+
+    out.resize(read);
+    return read == header.count;
+}
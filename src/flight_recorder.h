@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "car_io.h"
+
+#define FLIGHT_MAGIC "HFLT1\0\0"
+#define FLIGHT_VERSION 1
+
+#define FLIGHT_STATE 0
+#define FLIGHT_STEERS 1
+
+#pragma pack(push, 1)
+struct FlightHeader
+{
+    char magic[8];
+    uint32_t version, record_size, state_size, steers_size;
+    uint64_t count;
+};
+
+struct FlightRecord
+{
+    uint64_t ns;
+    uint16_t car, kind;
+    uint8_t payload[sizeof(CarState)];
+
+    CarState State() const
+    {
+        CarState state;
+        memcpy(&state, payload, sizeof(state));
+        return state;
+    }
+
+    CarSteers Steers() const
+    {
+        CarSteers steers;
+        memcpy(&steers, payload, sizeof(steers));
+        return steers;
+    }
+};
+#pragma pack(pop)
+
+// Keeps the last N states received and steers sent in a preallocated ring.
+// Recording is a copy into the next slot, all I/O is on a background thread:
+// a dump on SIGUSR1 or Dump(), and one at Stop(). A crash writes the ring
+// straight from the signal handler to <file>.crash.
+class FlightRecorder
+{
+    std::vector<FlightRecord> ring;
+    std::atomic<uint64_t> head{0};
+    std::chrono::steady_clock::time_point start_time;
+
+    std::string filename, crash_filename;
+    std::mutex lock;
+    std::condition_variable wakeup;
+    bool stop = false;
+    std::thread writer;
+
+    static FlightRecorder *active;
+    static std::atomic<bool> dump_requested;
+
+    static void OnDumpSignal(int);
+    static void OnCrashSignal(int signal);
+
+    void Write(uint16_t car, uint16_t kind, const void *payload, size_t size)
+    {
+        uint64_t index = head.load(std::memory_order_relaxed);
+        FlightRecord &record = ring[index % ring.size()];
+
+        record.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start_time)
+                        .count();
+        record.car = car;
+        record.kind = kind;
+        memcpy(record.payload, payload, size);
+
+        head.store(index + 1, std::memory_order_release);
+    }
+
+    void WriterLoop();
+    bool WriteFile();
+
+  public:
+    FlightRecorder(std::string filename, int records);
+    ~FlightRecorder();
+
+    void RecordState(int car, const CarState &state)
+    {
+        Write(car, FLIGHT_STATE, &state, sizeof(state));
+    }
+
+    void RecordSteers(int car, const CarSteers &steers)
+    {
+        Write(car, FLIGHT_STEERS, &steers, sizeof(steers));
+    }
+
+    void Dump();
+    void Stop();
+
+    static bool Load(std::string filename, std::vector<FlightRecord> &out);
+};
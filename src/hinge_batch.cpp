@@ -0,0 +1,143 @@
+#include <cmath>
+
+#include "hinge_batch.h"
+
+HingeBatch::HingeBatch(const HingyTrack &track,
+                       const std::vector<std::pair<float, float>> &forces)
+    : lanes(forces.size()), count(track.hinges.size())
+{
+    for (auto &force : forces)
+    {
+        straightening.push_back(force.first);
+        pulling.push_back(force.second);
+    }
+
+    for (auto &hinge : track.hinges)
+    {
+        a.push_back(hinge.a);
+        b.push_back(hinge.b);
+        lx.push_back(hinge.lx);
+        hx.push_back(hinge.hx);
+
+        for (int k = 0; k < lanes; k++)
+        {
+            x.push_back(hinge.x);
+            y.push_back(hinge.y);
+            curve.push_back(hinge.curve);
+        }
+    }
+
+    fx.resize(x.size());
+    fy.resize(x.size());
+}
+
+int HingeBatch::Lanes() const { return lanes; }
+
+// The arithmetic of HingyTrack::SimulateHinges, with the direction products
+// worked out to their cosines and sines, which it gets to through atan2 and
+// sqrt on every term.
+void HingeBatch::Simulate(int iterations)
+{
+    if (count < 2 || lanes == 0)
+        return;
+
+    std::vector<Direction> prev(lanes);
+    std::vector<float> prev_cos(lanes), prev_sin(lanes);
+
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        std::fill(fx.begin(), fx.end(), 0.0f);
+        std::fill(fy.begin(), fy.end(), 0.0f);
+
+        // The edge into hinge 0 closes the ring.
+        for (int k = 0; k < lanes; k++)
+        {
+            size_t last = (count - 1) * lanes + k;
+            prev[k].h = std::atan2(y[k] - y[last], x[k] - x[last]);
+            prev_cos[k] = std::cos(prev[k].h);
+            prev_sin[k] = std::sin(prev[k].h);
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t me = i * lanes;
+            size_t ip = ((i + count - 1) % count) * lanes;
+            size_t in = ((i + 1) % count) * lanes;
+
+            for (int k = 0; k < lanes; k++)
+            {
+                Direction next{std::atan2(y[in + k] - y[me + k],
+                                          x[in + k] - x[me + k])};
+                float next_cos = std::cos(next.h), next_sin = std::sin(next.h);
+
+                float angle_diff = next - prev[k];
+                Direction prev_inv = prev[k].Inv();
+                Direction perpendicular = prev_inv + (next - prev_inv) / 2.0f;
+                Direction perpendicular_inv = perpendicular.Inv();
+
+                float straighten = straightening[k] * angle_diff * angle_diff;
+                float toward_x = std::cos(perpendicular.h) * straighten;
+                float toward_y = std::sin(perpendicular.h) * straighten;
+                float away_x = std::cos(perpendicular_inv.h) * straighten;
+                float away_y = std::sin(perpendicular_inv.h) * straighten;
+                float pull = pulling[k];
+
+                fx[me + k] += 2.0f * toward_x +
+                              pull * (next_cos - prev_cos[k]);
+                fy[me + k] += 2.0f * toward_y +
+                              pull * (next_sin - prev_sin[k]);
+                fx[ip + k] += away_x + pull * prev_cos[k];
+                fy[ip + k] += away_y + pull * prev_sin[k];
+                fx[in + k] += away_x - pull * next_cos;
+                fy[in + k] += away_y - pull * next_sin;
+
+                curve[me + k] = std::abs(angle_diff);
+
+                prev[k] = next;
+                prev_cos[k] = next_cos;
+                prev_sin[k] = next_sin;
+            }
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            float ha = a[i], hb = b[i], low = lx[i], high = hx[i];
+            float pa = -1.0f / ha;
+            size_t me = i * lanes;
+
+            // The ends stay centred, as in SimulateHinges.
+            if (i == 0 || i == count - 1)
+                for (int k = 0; k < lanes; k++)
+                    x[me + k] = (low + high) / 2.0f;
+
+            for (int k = 0; k < lanes; k++)
+            {
+                float px = x[me + k] + fx[me + k];
+                float py = y[me + k] + fy[me + k];
+
+                // Hinge::ClapToAxis
+                float pb = py - pa * px;
+                px = -(pb - hb) / (pa - ha);
+                px = std::min(std::max(px, low), high);
+
+                x[me + k] = px;
+                y[me + k] = ha * px + hb;
+            }
+        }
+    }
+}
+
+void HingeBatch::Store(int lane, HingyTrack &track) const
+{
+    auto &hinges = track.hinges.Mutable();
+
+    for (size_t i = 0; i < count && i < hinges.size(); i++)
+    {
+        hinges[i].x = x[i * lanes + lane];
+        hinges[i].y = y[i * lanes + lane];
+        hinges[i].curve = curve[i * lanes + lane];
+    }
+
+    track.MarkSpeedsStale(0, hinges.size() - 1);
+    track.GeometryChanged();
+}
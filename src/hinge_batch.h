@@ -0,0 +1,33 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "hingy_track.h"
+
+// Relaxes the hinge ring of one track for several (straightening, pulling)
+// force pairs at once, as HingyTrack::SimulateHinges would for each. The
+// states are interleaved, lane k of hinge i at [i * lanes + k], so every
+// pass loads a hinge's axis once for all lanes, and each edge's angle is
+// computed once and shared by the two hinges at its ends.
+class HingeBatch
+{
+    int lanes;
+    size_t count;
+
+    // Per hinge, shared by every lane.
+    std::vector<float> a, b, lx, hx;
+    // Per hinge and lane.
+    std::vector<float> x, y, curve, fx, fy;
+    std::vector<float> straightening, pulling;
+
+  public:
+    // Every lane starts from the track's current hinges.
+    HingeBatch(const HingyTrack &track,
+               const std::vector<std::pair<float, float>> &forces);
+
+    int Lanes() const;
+    void Simulate(int iterations = 1);
+    // Replaces the track's hinge positions with those of a lane.
+    void Store(int lane, HingyTrack &track) const;
+};
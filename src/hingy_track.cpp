@@ -1,10 +1,20 @@
 #include <algorithm>
 #include <assert.h>
 #include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <new>
+
+#include <sys/stat.h>
 
 #include "hingy_track.h"
+#include "lap_fusion.h"
+#include "realtime.h"
+#include "track_codec.h"
 #include "utils.h"
+#include "waypoint_simplifier.h"
 
 #include "rapidxml/rapidxml.hpp"
 #include "rapidxml/rapidxml_print.hpp"
@@ -24,9 +34,26 @@ inline float sgn(float &a1)
     return -1.0f;
 }
 
-HingyTrack::HingyTrack(string filename) : filename(filename)
+HingyTrack::HingyTrack(string filename, const string &shared)
+    : filename(filename)
 {
-    if (file_exists(filename))
+    bool attached = shared != "" && AttachShared(shared);
+
+    if (!attached && file_exists(filename) &&
+        has_suffix(filename, TRACK_CODEC_SUFFIX))
+    {
+        std::vector<uint8_t> data(file_size(filename));
+        FILE *f = fopen(filename.c_str(), "rb");
+        bool read = f != NULL && fread(data.data(), 1, data.size(), f) ==
+                                     data.size();
+        if (f != NULL)
+            fclose(f);
+
+        if (!read || !decode_track(data.data(), data.size(),
+                                   waypoints.Mutable()))
+            log_error("Malformed track " + filename);
+    }
+    else if (!attached && file_exists(filename))
     {
         int size = file_size(filename);
         char *buf = new char[size + 1];
@@ -66,7 +93,7 @@ HingyTrack::HingyTrack(string filename) : filename(filename)
                 atof(waypoint_node->last_node()->previous_sibling()->value());
             waypoint.a = atof(waypoint_node->last_node()->value());
 
-            waypoints.push_back(waypoint);
+            waypoints.Mutable().push_back(waypoint);
             waypoint_node = waypoint_node->next_sibling();
         }
 
@@ -75,22 +102,89 @@ HingyTrack::HingyTrack(string filename) : filename(filename)
 
     string tmp = filename;
     std::replace(tmp.begin(), tmp.end(), '/', '_');
-    tmp_filename = (string) "tmp/" + tmp + (string) ".hinges";
-
-    waypoints.reserve(1000000);
+    cache_prefix = (string) "tmp/" + tmp + ".";
 }
 
-void HingyTrack::BeginRecording()
+void HingyTrack::BeginRecording(int laps, int threads, float tolerance)
 {
-    waypoints.clear();
+    waypoints.Mutable().clear();
+    recorded_laps.clear();
+    record_laps = std::max(laps, 1);
+    record_threads = threads;
+    simplifier = std::make_shared<WaypointSimplifier>(
+        tolerance, forward_factor, angle_factor);
 
     recording = true;
     fuse = true;
     fuse2 = false;
+
+    GeometryChanged();
 }
 
 void HingyTrack::StopRecording()
 {
+    if (fused_laps.valid())
+    {
+        TakeFusedLaps();
+        return;
+    }
+
+    if (simplifier)
+        simplifier->Flush(waypoints.Mutable());
+
+    if (recorded_laps.size() > 0)
+    {
+        waypoints.Mutable() = fuse_laps(recorded_laps, record_threads);
+        recorded_laps.clear();
+        GeometryChanged();
+    }
+
+    SaveWaypoints(filename);
+    recording = false;
+}
+
+void HingyTrack::FuseRecording()
+{
+    auto task = [laps = std::move(recorded_laps), threads = record_threads,
+                 filename = filename]() {
+        leave_realtime();
+        auto fused = fuse_laps(laps, threads);
+        SaveWaypoints(filename, fused);
+        return fused;
+    };
+
+    recorded_laps.clear();
+    fused_laps = std::async(std::launch::async, std::move(task)).share();
+}
+
+void HingyTrack::TakeFusedLaps()
+{
+    waypoints.Mutable() = fused_laps.get();
+    fused_laps = {};
+    recording = false;
+    GeometryChanged();
+}
+
+bool HingyTrack::SaveWaypoints(const std::string &filename) const
+{
+    return SaveWaypoints(
+        filename, std::vector<Waypoint>(waypoints.begin(), waypoints.end()));
+}
+
+bool HingyTrack::SaveWaypoints(const std::string &filename,
+                               const std::vector<Waypoint> &waypoints)
+{
+    if (has_suffix(filename, TRACK_CODEC_SUFFIX))
+    {
+        std::vector<uint8_t> data = encode_track(waypoints);
+        FILE *f = fopen(filename.c_str(), "wb");
+        if (f == NULL)
+            return false;
+
+        bool written = fwrite(data.data(), 1, data.size(), f) == data.size();
+        return fclose(f) == 0 && written;
+    }
+
     std::fstream fs;
     fs.open(filename.c_str(), std::fstream::out | std::fstream::trunc);
     std::vector<char *> to_be_deallocated;
@@ -128,38 +222,498 @@ void HingyTrack::StopRecording()
     for (auto str : to_be_deallocated)
         delete[] str;
 
-    recording = false;
+    return !fs.fail();
 }
 
-void HingyTrack::CacheHinges()
+#define HINGE_CACHE_MAGIC 0x32474e48 // "HNG2"
+
+// Leads every cache entry, the hinges and then the waypoints they were
+// relaxed on follow.
+struct HingeCacheHeader
 {
-    FILE *f = fopen(tmp_filename.c_str(), "wb");
+    uint32_t magic, hinge_size;
+    uint64_t track_hash, hinges, waypoints;
+    float force1, force2;
+};
 
-    if (f)
-    {
-        int hinges_written =
-            fwrite(hinges.data(), sizeof(Hinge), hinges.size(), f);
-        assert(hinges_written == hinges.size());
+static uint32_t float_bits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Relative, so parameters of any magnitude weigh the same.
+static float param_distance(float a, float b)
+{
+    float scale = std::max(std::max(std::abs(a), std::abs(b)), 1e-6f);
+    return (a - b) * (a - b) / (scale * scale);
+}
 
+static FILE *open_cache_entry(const string &name, HingeCacheHeader &header,
+                              size_t hinge_size)
+{
+    FILE *f = fopen(name.c_str(), "rb");
+    if (f == NULL)
+        return NULL;
+
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        header.magic != HINGE_CACHE_MAGIC || header.hinge_size != hinge_size)
+    {
         fclose(f);
+        return NULL;
     }
+
+    return f;
 }
 
-bool HingyTrack::LoadHingesFromCache()
+// Entries are only any good for the waypoints they were relaxed on.
+uint64_t HingyTrack::TrackHash() const
 {
-    FILE *f = fopen(tmp_filename.c_str(), "rb");
+    return fnv1a(waypoints.data(), waypoints.size() * sizeof(Waypoint));
+}
 
-    if (f)
+string HingyTrack::CacheEntry(float force1, float force2) const
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "%08x_%08x.hinges", float_bits(force1),
+             float_bits(force2));
+    return cache_prefix + suffix;
+}
+
+void HingyTrack::CacheHinges(float force1, float force2)
+{
+    string name = CacheEntry(force1, force2), tmp = name + ".tmp";
+    HingeCacheHeader header = {HINGE_CACHE_MAGIC, sizeof(Hinge),
+                               TrackHash(),       hinges.size(),
+                               waypoints.size(),  force1,
+                               force2};
+
+    mkdir("tmp", 0755);
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (f == NULL)
+        return;
+
+    bool written = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                   fwrite(hinges.data(), sizeof(Hinge), hinges.size(), f) ==
+                       hinges.size() &&
+                   fwrite(waypoints.data(), sizeof(Waypoint), waypoints.size(),
+                          f) == waypoints.size();
+    written = fclose(f) == 0 && written;
+
+    // Renamed into place, so bots starting together never read half of one.
+    if (!written || rename(tmp.c_str(), name.c_str()) != 0)
+        remove(tmp.c_str());
+}
+
+bool HingyTrack::LoadHingesFromCache(float force1, float force2, bool &exact)
+{
+    uint64_t track_hash = TrackHash();
+    float nearest = INFINITY;
+    string entry;
+
+    for (auto &name : list_files("tmp", ".hinges"))
     {
-        int hinges_read = fread(hinges.data(), sizeof(Hinge), hinges.size(), f);
-        assert(hinges_read == hinges.size());
+        if (name.compare(0, cache_prefix.size(), cache_prefix) != 0)
+            continue;
+
+        HingeCacheHeader header;
+        FILE *f = open_cache_entry(name, header, sizeof(Hinge));
+        if (f == NULL)
+            continue;
         fclose(f);
-        return true;
+
+        float distance = param_distance(force1, header.force1) +
+                         param_distance(force2, header.force2);
+        if (header.track_hash == track_hash &&
+            header.hinges == hinges.size() && distance < nearest)
+        {
+            nearest = distance;
+            entry = name;
+        }
+    }
+
+    HingeCacheHeader header;
+    FILE *f = entry == "" ? NULL : open_cache_entry(entry, header, sizeof(Hinge));
+    if (f == NULL)
+        return false;
+
+    // Read aside, a short entry leaves the hinges as they were.
+    std::vector<Hinge> loaded(hinges.size());
+    size_t hinges_read = fread(loaded.data(), sizeof(Hinge), loaded.size(), f);
+    fclose(f);
+
+    if (hinges_read != loaded.size())
+        return false;
+
+    this->hinges.Mutable().swap(loaded);
+    exact = nearest == 0.0f;
+    MarkSpeedsStale(0, hinges.size() - 1);
+    GeometryChanged();
+    return true;
+}
+
+bool HingyTrack::HingesSettled(float tolerance)
+{
+    if (++settle_calls % HINGE_SETTLE_WINDOW != 0)
+        return false;
+
+    bool first = settle_positions.size() != hinges.size();
+    float drift_sq = 0.0f;
+
+    settle_positions.resize(hinges.size());
+    for (int i = 0; i < hinges.size(); i++)
+    {
+        Vector2D position = hinges[i].ToWaypoint();
+        float drift = (position - settle_positions[i]).Length();
+
+        drift_sq += drift * drift;
+        settle_positions[i] = position;
+    }
+
+    return !first && std::sqrt(drift_sq / hinges.size()) < tolerance;
+}
+
+static bool same_waypoint(const HingyTrack::Waypoint &a,
+                          const HingyTrack::Waypoint &b)
+{
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// Where the hinges go, one on the first waypoint past every skip metres.
+static std::vector<int>
+hinge_waypoints(const SharedArray<HingyTrack::Waypoint> &waypoints, float skip)
+{
+    std::vector<int> selected;
+    float fuse = FLT_MAX;
+
+    for (int i = 0; i < waypoints.size(); i++)
+    {
+        if (waypoints[i].f + fuse > skip)
+        {
+            selected.push_back(i);
+            fuse = 0.0f;
+        }
+        else
+        {
+            fuse += waypoints[i].f;
+        }
     }
 
-    return false;
+    return selected;
 }
 
+bool HingyTrack::PatchHinges(const HingyTrack &old, float straightening_factor,
+                             float pulling_factor, int iterations,
+                             float tolerance, Patch &patch)
+{
+    int old_count = old.waypoints.size(), count = waypoints.size();
+    auto old_selected = hinge_waypoints(old.waypoints, old.hinge_sep);
+    auto selected = hinge_waypoints(waypoints, hinge_sep);
+
+    if (old.hinge_sep != hinge_sep || old.hinges.size() < 2 ||
+        old_selected.size() != old.hinges.size() ||
+        old.bounds.size() != old_count || selected.size() != hinges.size() ||
+        hinges.size() < 2)
+        return false;
+
+    // The edit is whatever lies between the common start and end.
+    int first = 0, tail = 0;
+    while (first < old_count && first < count &&
+           same_waypoint(old.waypoints[first], waypoints[first]))
+        first++;
+    while (tail < old_count - first && tail < count - first &&
+           same_waypoint(old.waypoints[old_count - 1 - tail],
+                         waypoints[count - 1 - tail]))
+        tail++;
+
+    // Hinges away from the edit keep the waypoint they had in old, -1 for
+    // the edited ones.
+    int n = hinges.size();
+    std::vector<int> kept(n, -1);
+    std::vector<char> window(n, 0);
+
+    for (int i = 0; i < n; i++)
+    {
+        int w = selected[i];
+        if (w < first)
+            kept[i] = w;
+        else if (w >= count - tail)
+            kept[i] = w - count + old_count;
+    }
+
+    // Not an edit of old so much as another track.
+    if (std::count(kept.begin(), kept.end(), -1) > n / 2)
+        return false;
+
+    // A kept hinge sits as far along its axis as it did in old, the axis
+    // itself may have been carried along by the edit. When the edit changed
+    // the length, the hinges after it fall on other waypoints than in old,
+    // and go where old's line between its neighbours crossed that axis.
+    auto &hinges = this->hinges.Mutable();
+    std::vector<char> moved(n, 0);
+
+    for (int i = 0; i < n; i++)
+    {
+        if (kept[i] < 0)
+            continue;
+
+        int old_w = kept[i];
+        int j = std::upper_bound(old_selected.begin(), old_selected.end(),
+                                 old_w) -
+                old_selected.begin() - 1;
+        j = (j + old_selected.size()) % old_selected.size();
+
+        auto &old_bound = old.bounds[old_w];
+        Vector2D axis_start = old_bound.first;
+        Vector2D axis = Vector2D(old_bound.second) - axis_start;
+        float along;
+
+        if (old_selected[j] == old_w)
+        {
+            along = (old.hinges[j].x - axis_start.x) / axis.x;
+        }
+        else
+        {
+            Vector2D from = old.hinges[j].ToWaypoint();
+            Vector2D line =
+                old.hinges[(j + 1) % old.hinges.size()].ToWaypoint() - from;
+            Vector2D offset = from - axis_start;
+            float cross = axis.x * line.y - axis.y * line.x;
+
+            along = std::abs(cross) > 1e-9f
+                        ? (offset.x * line.y - offset.y * line.x) / cross
+                        : 0.5f;
+            along = std::min(std::max(along, 0.0f), 1.0f);
+            moved[i] = 1;
+        }
+
+        auto &bound = bounds[selected[i]];
+        hinges[i].x = bound.first.x + along * (bound.second.x - bound.first.x);
+        hinges[i].y = hinges[i].a * hinges[i].x + hinges[i].b;
+        hinges[i].curve = old.hinges[j].curve;
+        hinges[i].desired_speed = old.hinges[j].desired_speed;
+    }
+
+    auto &old_end = old.bounds[old_count - 1].first;
+    auto &end = bounds[count - 1].first;
+    bool seam = first < count && (old_end.x != end.x || old_end.y != end.y);
+
+    // The relaxed window starts as the edit and the seam, with margins, and
+    // the hinges that fell on other waypoints.
+    for (int i = 0; i < n; i++)
+    {
+        bool near = moved[i] || (seam && (i < HINGE_PATCH_MARGIN ||
+                                          i >= n - HINGE_PATCH_MARGIN));
+        for (int d = -HINGE_PATCH_MARGIN; d <= HINGE_PATCH_MARGIN; d++)
+            near = near || kept[(i + d + n) % n] < 0;
+        window[i] = near;
+    }
+
+    patch.first_waypoint = first;
+    patch.old_waypoints = old_count - tail - first;
+    patch.new_waypoints = count - tail - first;
+    patch.relaxed = std::count(window.begin(), window.end(), 1);
+    patch.iterations = 0;
+
+    // Old's profile still holds away from the edit, the curves change on
+    // the window and the hinges either side of it.
+    std::copy(old.speed_params, old.speed_params + 3, speed_params);
+    speeds_stale_first = INT_MAX;
+    speeds_stale_last = -1;
+    // No forces, only the curves refreshed.
+    std::vector<Vector2D> unused(n);
+    for (int i = 0; i < n; i++)
+        if (window[i])
+            for (int d = -1; d <= 1; d++)
+            {
+                HingeForces((i + d + n) % n, 0.0f, 0.0f, unused);
+                MarkSpeedsStale((i + d + n) % n, (i + d + n) % n);
+            }
+
+    // How far an edit reaches depends on where the line next touches a
+    // bound, so the window grows past any hinge on its edge that moved
+    // noticeably from where it was held.
+    std::vector<Vector2D> held(n);
+    for (int i = 0; i < n; i++)
+        held[i] = hinges[i].ToWaypoint();
+
+    settle_positions.clear();
+    settle_calls = 0;
+
+    while (patch.relaxed > 0 && patch.iterations < iterations)
+    {
+        RelaxHinges(straightening_factor, pulling_factor, window);
+        patch.iterations++;
+
+        // HingesSettled() averages over the whole ring, the held hinges
+        // contribute no drift.
+        bool settled = HingesSettled(
+            tolerance * std::sqrt((float)patch.relaxed / (float)n));
+        if (patch.iterations % HINGE_SETTLE_WINDOW != 0)
+            continue;
+
+        std::vector<char> grown = window;
+        for (int i = 0; i < n; i++)
+        {
+            bool edge = window[i] && (!window[(i + 1) % n] ||
+                                      !window[(i - 1 + n) % n]);
+            if (!edge ||
+                (hinges[i].ToWaypoint() - held[i]).Length() < HINGE_PATCH_HOLD)
+                continue;
+
+            for (int d = -HINGE_PATCH_MARGIN; d <= HINGE_PATCH_MARGIN; d++)
+                grown[(i + d + n) % n] = 1;
+        }
+
+        int relaxed = std::count(grown.begin(), grown.end(), 1);
+        if (relaxed == patch.relaxed && settled)
+            break;
+
+        window = grown;
+        patch.relaxed = relaxed;
+    }
+
+    GeometryChanged();
+    return true;
+}
+
+bool HingyTrack::PatchHingesFromCache(float force1, float force2,
+                                      int iterations, float tolerance,
+                                      Patch &patch)
+{
+    HingeCacheHeader header;
+    FILE *f = open_cache_entry(CacheEntry(force1, force2), header,
+                               sizeof(Hinge));
+    if (f == NULL)
+        return false;
+
+    // The entry's bounds and hinge axes come from its waypoints, the relaxed
+    // positions are put back on them.
+    HingyTrack old("");
+    auto &old_waypoints = old.waypoints.Mutable();
+    auto &old_hinges = old.hinges.Mutable();
+    old_hinges.resize(header.hinges);
+    old_waypoints.resize(header.waypoints);
+
+    bool read = header.track_hash != TrackHash() &&
+                fread(old_hinges.data(), sizeof(Hinge), old_hinges.size(),
+                      f) == old_hinges.size() &&
+                fread(old_waypoints.data(), sizeof(Waypoint),
+                      old_waypoints.size(), f) == old_waypoints.size();
+    fclose(f);
+
+    if (!read)
+        return false;
+
+    auto relaxed = old_hinges;
+    old.ConstructBounds();
+    old.ConstructHinges(hinge_sep);
+    if (old.hinges.size() != relaxed.size())
+        return false;
+    old.hinges.Mutable() = relaxed;
+
+    return PatchHinges(old, force1, force2, iterations, tolerance, patch);
+}
+
+// Arrays start on cache lines, whatever comes before them.
+static size_t segment_offset(size_t offset) { return (offset + 63) & ~63ul; }
+
+bool HingyTrack::AttachShared(std::shared_ptr<const TrackStoreHeader> image)
+{
+    if (!image || image->waypoint_size != sizeof(Waypoint) ||
+        image->bound_size != sizeof(*bounds.data()) ||
+        image->hinge_size != sizeof(Hinge) ||
+        image->waypoints_offset + image->waypoints * sizeof(Waypoint) >
+            image->bytes ||
+        image->bounds_offset + image->bounds * sizeof(*bounds.data()) >
+            image->bytes ||
+        image->hinges_offset + image->hinges * sizeof(Hinge) > image->bytes)
+        return false;
+
+    const char *base = (const char *)image.get();
+    waypoints.Attach(image, (const Waypoint *)(base + image->waypoints_offset),
+                     image->waypoints);
+    bounds.Attach(image,
+                  (const std::pair<Vector2D, Vector2D> *)(base +
+                                                          image->bounds_offset),
+                  image->bounds);
+    hinges.Attach(image, (const Hinge *)(base + image->hinges_offset),
+                  image->hinges);
+
+    hinge_sep = image->hinge_sep;
+    std::copy(image->speed_params, image->speed_params + 3, speed_params);
+    speeds_stale_first = INT_MAX;
+    speeds_stale_last = -1;
+    GeometryChanged();
+
+    return true;
+}
+
+bool HingyTrack::AttachShared(const std::string &key)
+{
+    return AttachShared(TrackStore::Attach(key));
+}
+
+size_t HingyTrack::SharedBytes() const
+{
+    size_t offset = segment_offset(sizeof(TrackStoreHeader));
+    offset = segment_offset(offset + waypoints.size() * sizeof(Waypoint));
+    offset = segment_offset(offset + bounds.size() * sizeof(*bounds.data()));
+
+    return offset + hinges.size() * sizeof(Hinge);
+}
+
+void HingyTrack::WriteShared(TrackStoreHeader *image) const
+{
+    char *base = (char *)image;
+
+    image->waypoint_size = sizeof(Waypoint);
+    image->bound_size = sizeof(*bounds.data());
+    image->hinge_size = sizeof(Hinge);
+    image->waypoints = waypoints.size();
+    image->bounds = bounds.size();
+    image->hinges = hinges.size();
+    image->waypoints_offset = segment_offset(sizeof(TrackStoreHeader));
+    image->bounds_offset = segment_offset(
+        image->waypoints_offset + waypoints.size() * sizeof(Waypoint));
+    image->hinges_offset = segment_offset(
+        image->bounds_offset + bounds.size() * sizeof(*bounds.data()));
+    image->bytes = image->hinges_offset + hinges.size() * sizeof(Hinge);
+    image->hinge_sep = hinge_sep;
+    std::copy(speed_params, speed_params + 3, image->speed_params);
+
+    std::copy(waypoints.begin(), waypoints.end(),
+              (Waypoint *)(base + image->waypoints_offset));
+    std::copy(bounds.begin(), bounds.end(),
+              (std::pair<Vector2D, Vector2D> *)(base + image->bounds_offset));
+    std::copy(hinges.begin(), hinges.end(),
+              (Hinge *)(base + image->hinges_offset));
+}
+
+bool HingyTrack::PublishShared(const std::string &key)
+{
+    TrackStoreHeader *image = TrackStore::Create(key, SharedBytes());
+    if (image == NULL)
+        return false;
+
+    WriteShared(image);
+    TrackStore::Seal(image);
+    return AttachShared(key);
+}
+
+bool HingyTrack::SaveArtifact(const std::string &filename) const
+{
+    // 64 bit words keep the header aligned.
+    std::vector<uint64_t> image((SharedBytes() + 7) / 8);
+    auto header = new (image.data()) TrackStoreHeader();
+
+    WriteShared(header);
+    return TrackStore::Save(filename, header);
+}
+
+bool HingyTrack::Shared() const { return hinges.Shared(); }
+
 void HingyTrack::MarkWaypoint(float forward, float l, float r, float angle,
                               float speed)
 {
@@ -173,6 +727,14 @@ void HingyTrack::MarkWaypoint(float forward, float l, float r, float angle,
                           hinges[current_hinge].forward;
     }
 
+    if (fused_laps.valid())
+    {
+        if (fused_laps.wait_for(std::chrono::seconds(0)) ==
+            std::future_status::ready)
+            TakeFusedLaps();
+        return;
+    }
+
     if (recording)
     {
         if (last_forward - forward > 60.0f && !fuse)
@@ -184,13 +746,27 @@ void HingyTrack::MarkWaypoint(float forward, float l, float r, float angle,
 
         if (!fuse)
         {
+            // Each lap runs from here to here the next time round.
             if (forward > 50.0f && fuse2)
             {
-                StopRecording();
+                simplifier->Flush(waypoints.Mutable());
+                recorded_laps.emplace_back(waypoints.begin(), waypoints.end());
+                if (recorded_laps.size() >= record_laps)
+                {
+                    FuseRecording();
+                    return;
+                }
+
+                waypoints.Mutable().clear();
+                fuse2 = false;
+                last_forward = forward;
+                GeometryChanged();
                 return;
             }
-            waypoints.push_back(std::move(
-                HingyTrack::Waypoint{forward - last_forward, angle, l, r}));
+            simplifier->Add(
+                HingyTrack::Waypoint{forward - last_forward, angle, l, r},
+                waypoints.Mutable());
+            GeometryChanged();
         }
         else if (forward > 50.0f && forward < 60.0f)
         {
@@ -222,25 +798,30 @@ void HingyTrack::ConstructBounds()
             y +
             std::sin(heading - M_PI / 2.0f) * /*waypoint.r * */ bound_factor;
 
-        bounds.push_back(
+        bounds.Mutable().push_back(
             std::pair<Vector2D, Vector2D>(Vector2D{lx, ly}, Vector2D{rx, ry}));
 
         x += std::cos(heading) * forward_factor * waypoint.f;
         y += std::sin(heading) * forward_factor * waypoint.f;
         heading += waypoint.a * angle_factor;
     }
+
+    GeometryChanged();
 }
 
 void HingyTrack::ConstructHinges(float skip)
 {
+    auto &hinges = this->hinges.Mutable();
+    auto &bounds = this->bounds.Mutable();
     hinge_sep = skip;
     hinges.clear();
-    float fuse = FLT_MAX, forward_sum = 0.0f;
-    int i = 0;
+    auto selected = hinge_waypoints(waypoints, skip);
+    float forward_sum = 0.0f;
+    int i = 0, next = 0;
 
     for (auto bound = bounds.begin(); bound != bounds.end(); ++bound)
     {
-        if (waypoints[i].f + fuse > skip)
+        if (next < selected.size() && selected[next] == i)
         {
             Hinge h;
 
@@ -260,11 +841,7 @@ void HingyTrack::ConstructHinges(float skip)
             h.forward = forward_sum;
 
             hinges.push_back(std::move(h));
-            fuse = 0.0f;
-        }
-        else
-        {
-            fuse += waypoints[i].f;
+            next++;
         }
 
         forward_sum += waypoints[i].f;
@@ -281,68 +858,133 @@ void HingyTrack::ConstructHinges(float skip)
         me.true_heading.h =
             std::atan2(next.ToWaypoint().y - me.ToWaypoint().y, next.x - me.x);
     }
+
+    MarkSpeedsStale(0, hinges.size() - 1);
+    GeometryChanged();
+}
+
+void HingyTrack::HingeForces(int i, float straightening_factor,
+                             float pulling_factor,
+                             std::vector<Vector2D> &forces)
+{
+    auto &hinges = this->hinges.Mutable();
+    auto ip = (i - 1 + hinges.size()) % hinges.size();
+    auto in = (i + 1) % hinges.size();
+
+    const Hinge &prev = hinges[ip];
+    Hinge &me = hinges[i];
+    const Hinge &next = hinges[in];
+
+    auto angle_to_next =
+        (Vector2D(next.x, next.y) - Vector2D(me.x, me.y)).ToDirection();
+    auto angle_from_prev =
+        (Vector2D(me.x, me.y) - Vector2D(prev.x, prev.y)).ToDirection();
+    auto angle_diff = angle_to_next - angle_from_prev;
+    auto angle_diff2 = (angle_to_next - angle_from_prev.Inv());
+    auto perpendicular_angle = angle_from_prev.Inv() + angle_diff2 / 2.0f;
+    auto direction =
+        std::abs((Vector2D(next.x, next.y) - Vector2D(prev.x, prev.y))
+                     .ToDirection()
+                     .h);
+
+    auto dist_to_prev =
+        (Vector2D(prev.x, prev.y) - Vector2D(me.x, me.y)).Length();
+    auto dist_to_next =
+        (Vector2D(next.x, next.y) - Vector2D(me.x, me.y)).Length();
+
+    forces[i] += Vector2D(straightening_factor * 2.0f, 0.0f) *
+                 (perpendicular_angle)*std::abs(std::pow(angle_diff, 2.0f));
+    forces[ip] += Vector2D(straightening_factor, 0.0f) *
+                  (perpendicular_angle.Inv()) *
+                  std::abs(std::pow(angle_diff, 2.0f));
+    forces[in] += Vector2D(straightening_factor, 0.0f) *
+                  (perpendicular_angle.Inv()) *
+                  std::abs(std::pow(angle_diff, 2.0f));
+
+    me.curve = std::abs(angle_diff);
+
+    forces[i] += Vector2D(pulling_factor, 0.0f) * angle_to_next;
+    forces[in] += Vector2D(-pulling_factor, 0.0f) * angle_to_next;
+
+    forces[i] += Vector2D(-pulling_factor, 0.0f) * angle_from_prev;
+    forces[ip] += Vector2D(pulling_factor, 0.0f) * angle_from_prev;
 }
 
 void HingyTrack::SimulateHinges(float straightening_factor,
                                 float pulling_factor)
 {
+    auto &hinges = this->hinges.Mutable();
     auto forces = std::vector<Vector2D>(hinges.size());
 
     for (int i = 0; i < hinges.size(); i++)
-    {
-        auto force = Vector2D(0.0f, 0.0f);
-        auto ip = (i - 1 + hinges.size()) % hinges.size();
-        auto in = (i + 1) % hinges.size();
-
-        const Hinge &prev = hinges[ip];
-        Hinge &me = hinges[i];
-        const Hinge &next = hinges[in];
-
-        auto angle_to_next =
-            (Vector2D(next.x, next.y) - Vector2D(me.x, me.y)).ToDirection();
-        auto angle_from_prev =
-            (Vector2D(me.x, me.y) - Vector2D(prev.x, prev.y)).ToDirection();
-        auto angle_diff = angle_to_next - angle_from_prev;
-        auto angle_diff2 = (angle_to_next - angle_from_prev.Inv());
-        auto perpendicular_angle = angle_from_prev.Inv() + angle_diff2 / 2.0f;
-        auto direction =
-            std::abs((Vector2D(next.x, next.y) - Vector2D(prev.x, prev.y))
-                         .ToDirection()
-                         .h);
-
-        auto dist_to_prev =
-            (Vector2D(prev.x, prev.y) - Vector2D(me.x, me.y)).Length();
-        auto dist_to_next =
-            (Vector2D(next.x, next.y) - Vector2D(me.x, me.y)).Length();
-
-        forces[i] += Vector2D(straightening_factor * 2.0f, 0.0f) *
-                     (perpendicular_angle)*std::abs(std::pow(angle_diff, 2.0f));
-        forces[ip] += Vector2D(straightening_factor, 0.0f) *
-                      (perpendicular_angle.Inv()) *
-                      std::abs(std::pow(angle_diff, 2.0f));
-        forces[in] += Vector2D(straightening_factor, 0.0f) *
-                      (perpendicular_angle.Inv()) *
-                      std::abs(std::pow(angle_diff, 2.0f));
-
-        me.curve = std::abs(angle_diff);
-
-        forces[i] += Vector2D(pulling_factor, 0.0f) * angle_to_next;
-        forces[in] += Vector2D(-pulling_factor, 0.0f) * angle_to_next;
-
-        forces[i] += Vector2D(-pulling_factor, 0.0f) * angle_from_prev;
-        forces[ip] += Vector2D(pulling_factor, 0.0f) * angle_from_prev;
-    }
+        HingeForces(i, straightening_factor, pulling_factor, forces);
 
     hinges.begin()->x = (hinges.begin()->lx + hinges.begin()->hx) / 2.0f;
     (hinges.end() - 1)->x =
         ((hinges.end() - 1)->lx + (hinges.end() - 1)->hx) / 2.0f;
 
+    bool dump = diagnostics->Enabled();
+    float moved_sq = 0.0f, moved_max = 0.0f;
+
     for (int i = 0; i < hinges.size(); i++)
     {
+        Vector2D before = hinges[i].ToWaypoint();
+
+        hinges[i].x += forces[i].x;
+        hinges[i].y += forces[i].y;
+        hinges[i].ClapToAxis();
+
+        if (dump)
+        {
+            float moved = (hinges[i].ToWaypoint() - before).Length();
+            moved_sq += moved * moved;
+            moved_max = std::max(moved_max, moved);
+        }
+    }
+
+    // How far the hinges still move after the axis clamp: the residual the
+    // relaxation is driving to zero.
+    if (dump)
+        diagnostics->Write(
+            diagnostics->Open("hinges", {"iteration", "rms_move", "max_move"}),
+            {(float)simulate_iterations,
+             std::sqrt(moved_sq / std::max<size_t>(hinges.size(), 1)),
+             moved_max});
+    simulate_iterations++;
+
+    MarkSpeedsStale(0, hinges.size() - 1);
+    GeometryChanged();
+}
+
+void HingyTrack::RelaxHinges(float straightening_factor, float pulling_factor,
+                             const std::vector<char> &window)
+{
+    auto &hinges = this->hinges.Mutable();
+    int n = hinges.size();
+    auto forces = std::vector<Vector2D>(n);
+
+    // A hinge is pushed by its own angle and both neighbours'.
+    for (int i = 0; i < n; i++)
+        if (window[(i - 1 + n) % n] || window[i] || window[(i + 1) % n])
+        {
+            HingeForces(i, straightening_factor, pulling_factor, forces);
+            MarkSpeedsStale(i, i);
+        }
+
+    for (int i = 0; i < n; i++)
+    {
+        if (!window[i])
+            continue;
+
+        if (i == 0 || i == n - 1)
+            hinges[i].x = (hinges[i].lx + hinges[i].hx) / 2.0f;
+
         hinges[i].x += forces[i].x;
         hinges[i].y += forces[i].y;
         hinges[i].ClapToAxis();
     }
+
+    GeometryChanged();
 }
 
 std::pair<float, float> HingyTrack::GetHingePosAndHeading(float forward)
@@ -401,33 +1043,64 @@ float HingyTrack::GetHingeSpeed()
 
 bool HingyTrack::Recording() { return recording; }
 
+void HingyTrack::MarkSpeedsStale(int first, int last)
+{
+    speeds_stale_first = std::min(speeds_stale_first, first);
+    speeds_stale_last = std::max(speeds_stale_last, last);
+}
+
+// Energy runs backwards from the end of the ring, so a change only reaches
+// the hinges before it, and only until the energy there is what it was.
 void HingyTrack::ConstructSpeeds(float s, float p, float c)
 {
-    float energy = 1.0f;
-    int counter = hinges.size();
+    int n = hinges.size();
+    if (n == 0)
+        return;
 
-    if (hinges.size() == 0)
+    bool dump = diagnostics->Enabled();
+    bool same = s == speed_params[0] && p == speed_params[1] &&
+                c == speed_params[2] && !dump;
+    int first = same ? speeds_stale_first : 0;
+    int last = same ? std::min(speeds_stale_last, n - 1) : n - 1;
+
+    // Includes a shared profile built from the same parameters.
+    if (last < 0)
         return;
 
-    FILE *f = fopen("energy_dump.txt", "w");
-    for (auto i = hinges.rbegin(); i != hinges.rend(); i++)
+    auto &hinges = this->hinges.Mutable();
+    speed_params[0] = s;
+    speed_params[1] = p;
+    speed_params[2] = c;
+
+    int channel =
+        dump ? diagnostics->Open("speeds", {"forward", "energy", "curve"}) : 0;
+    float energy = last == n - 1 ? 1.0f : hinges[last + 1].desired_speed;
+
+    for (int i = last; i >= 0; i--)
     {
-        energy -= (s * std::pow(i->curve, 2.0f) + p) * i->curve - c;
+        energy -= (s * std::pow(hinges[i].curve, 2.0f) + p) * hinges[i].curve -
+                  c;
 
         if (energy > 1.0f)
             energy = 1.0f;
         else if (energy < 0.0f)
             energy = 0.0f;
 
-        if (energy > 0.70f && i->curve > 0.075f)
+        if (energy > 0.70f && hinges[i].curve > 0.075f)
             energy = 0.7f;
 
-        i->desired_speed = energy;
-        counter -= 1;
-        fprintf(f, "%f %f %f\n", i->forward, energy, std::abs(i->curve));
+        if (i < first && hinges[i].desired_speed == energy)
+            break;
+
+        hinges[i].desired_speed = energy;
+        if (dump)
+            diagnostics->Write(channel, {hinges[i].forward, energy,
+                                         std::abs(hinges[i].curve)});
     }
 
-    fclose(f);
+    speeds_stale_first = INT_MAX;
+    speeds_stale_last = -1;
+    GeometryChanged();
 }
 
 int HingyTrack::GetCurrentHinge(float fwd)
@@ -439,49 +1112,244 @@ int HingyTrack::GetCurrentHinge(float fwd)
     return (current_hinge + hinges.size() - 1) % hinges.size();
 }
 
+int HingyTrack::CurrentHinge() const { return current_hinge; }
+
+template <typename T> static size_t prefault_array(const SharedArray<T> &v)
+{
+    size_t bytes = v.size() * sizeof(T);
+    const volatile char *data = (const volatile char *)v.data();
+
+    for (size_t offset = 0; offset < bytes; offset += 4096)
+        (void)data[offset];
+
+    return bytes;
+}
+
+size_t HingyTrack::Prefault() const
+{
+    return prefault_array(waypoints) + prefault_array(bounds) +
+           prefault_array(hinges);
+}
+
+const SharedArray<HingyTrack::Waypoint> &HingyTrack::GetWaypoints() const
+{
+    return waypoints;
+}
+
+float HingyTrack::GetWaypointCurvature(const Waypoint &waypoint) const
+{
+    // Waypoint angles are recorded as (right - left) wheel spin times -dt, so
+    // a left turn is negative; curvature here is positive to the left, 1/m.
+    if (waypoint.f <= 0.0f)
+        return 0.0f;
+
+    return -waypoint.a * angle_factor / waypoint.f;
+}
+
+void HingyTrack::GeometryChanged()
+{
+    snapshot_geometry.reset();
+    indices_stale = true;
+}
+
+void HingyTrack::RefitIndices()
+{
+    if (!indices_stale)
+        return;
+
+    std::vector<std::pair<Vector2D, Vector2D>> segments;
+
+    for (size_t i = 0; i < hinges.size(); i++)
+        segments.emplace_back(hinges[i].ToWaypoint(),
+                              hinges[(i + 1) % hinges.size()].ToWaypoint());
+    hinge_index.Refit(segments);
+
+    // Left edges, then right ones.
+    segments.clear();
+    for (size_t i = 0; i + 1 < bounds.size(); i++)
+        segments.emplace_back(bounds[i].first, bounds[i + 1].first);
+    for (size_t i = 0; i + 1 < bounds.size(); i++)
+        segments.emplace_back(bounds[i].second, bounds[i + 1].second);
+    bound_index.Refit(segments);
+
+    indices_stale = false;
+}
+
+int HingyTrack::NearestHinge(Vector2D point)
+{
+    RefitIndices();
+    return hinge_index.NearestStart(point);
+}
+
+int HingyTrack::NearestEdge(Vector2D point)
+{
+    RefitIndices();
+    return hinge_index.NearestSegment(point);
+}
+
+std::vector<int> HingyTrack::CrossedEdges(Vector2D a, Vector2D b)
+{
+    std::vector<int> crossed;
+
+    RefitIndices();
+    hinge_index.Crossing(a, b, crossed);
+    return crossed;
+}
+
+std::vector<int> HingyTrack::CrossedBounds(Vector2D a, Vector2D b)
+{
+    std::vector<int> crossed;
+    int edges = bounds.size() > 0 ? bounds.size() - 1 : 0;
+
+    RefitIndices();
+    bound_index.Crossing(a, b, crossed);
+
+    for (auto &edge : crossed)
+        edge %= edges;
+    std::sort(crossed.begin(), crossed.end());
+    crossed.erase(std::unique(crossed.begin(), crossed.end()), crossed.end());
+    return crossed;
+}
+
+TrackGeometry HingyTrack::GetGeometry() const
+{
+    TrackGeometry geometry;
+    float heading = HALF_PI / 2.0f;
+    Vector2D pos;
+
+    // Same integration as ConstructBounds, so the layers line up.
+    geometry.path.push_back(pos);
+    for (const auto &waypoint : waypoints)
+    {
+        pos.x += std::cos(heading) * forward_factor * waypoint.f;
+        pos.y += std::sin(heading) * forward_factor * waypoint.f;
+        heading += waypoint.a * angle_factor;
+        geometry.path.push_back(pos);
+    }
+
+    geometry.bounds.assign(bounds.begin(), bounds.end());
+
+    for (const auto &hinge : hinges)
+    {
+        geometry.hinges.push_back(hinge.ToWaypoint());
+        geometry.speeds.push_back(hinge.desired_speed);
+    }
+
+    return geometry;
+}
+
+void HingyTrack::SetDiagnostics(std::shared_ptr<DiagnosticsSink> diagnostics)
+{
+    this->diagnostics = diagnostics;
+}
+
+std::shared_ptr<DiagnosticsSink> HingyTrack::GetDiagnostics()
+{
+    return diagnostics;
+}
+
+void HingyTrack::AttachSnapshots(std::shared_ptr<TrackSnapshots> snapshots)
+{
+    this->snapshots = snapshots;
+}
+
+void HingyTrack::Snapshot(const std::string &name, int index)
+{
+    if (!snapshots)
+        return;
+
+    if (!snapshot_geometry)
+        snapshot_geometry = std::make_shared<const TrackGeometry>(GetGeometry());
+
+    snapshots->Queue(snapshot_geometry, hinges.size() ? current_hinge : -1,
+                     name, index);
+}
+
 // === GUI ===
 
 HingyTrackGui::~HingyTrackGui() { KillGui(); }
 
-HingyTrackGui::HingyTrackGui(string filename, int resx, int resy)
-    : HingyTrack(filename), rx(resx), ry(resy)
+HingyTrackGui::HingyTrackGui(string filename, int resx, int resy, int fps,
+                             const string &shared)
+    : HingyTrack(filename, shared), rx(resx), ry(resy), fps(fps)
 {
-    SDL_Init(SDL_INIT_VIDEO);
+    render_thread = std::thread(&HingyTrackGui::RenderLoop, this);
+}
 
-    win = SDL_CreateWindow("HingyBot", 100, 100, resx, resy, 0);
-    renderer = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED);
-    SDL_ShowWindow(win);
+void HingyTrackGui::PublishFrame(bool force)
+{
+    if (!force && frames.Pending())
+        return;
+
+    auto &frame = frames.Back();
+
+    // Forced publishes are the ones that follow geometry changes. Each slot
+    // remembers which geometry it holds, so only stale slots are refilled.
+    if (force)
+        geometry++;
+
+    if (frame.geometry != geometry)
+    {
+        frame.hinges.clear();
+        frame.speeds.clear();
+        for (const auto &hinge : hinges)
+        {
+            frame.hinges.push_back(hinge.ToWaypoint());
+            frame.speeds.push_back(hinge.desired_speed);
+        }
+        frame.geometry = geometry;
+    }
+
+    // Waypoints only grow while recording a lap, the slot just catches up.
+    frame.recording = recording;
+    if (!recording || frame.lap != recorded_laps.size() ||
+        frame.waypoints.size() > waypoints.size())
+        frame.waypoints.clear();
+    frame.lap = recorded_laps.size();
+    if (recording)
+        frame.waypoints.insert(frame.waypoints.end(),
+                               waypoints.begin() + frame.waypoints.size(),
+                               waypoints.end());
+
+    frames.Publish();
 }
 
 void HingyTrackGui::MarkWaypoint(float forward, float l, float r, float angle,
                                  float speed)
 {
-    TickGraphics();
+    if (closed)
+    {
+        KillGui();
+    }
+    else
+    {
+        shown_hinge = current_hinge;
+        if (recording)
+            PublishFrame(false);
+    }
+
     HingyTrack::MarkWaypoint(forward, l, r, angle, speed);
 }
 
-void HingyTrackGui::DrawTrack()
+void HingyTrackGui::DrawTrack(const Frame &frame)
 {
-    SDL_SetRenderDrawColor(renderer, 100, 100, 100, 255);
+    std::vector<SDL_FPoint> points = {track_end};
+    int count = frame.waypoints.size();
 
-    float heading = HALF_PI / 2.0f;
-    float lx = rx / 2, ly = ry / 2;
-
-    int i = 0;
-
-    for (const auto &waypoint : waypoints)
+    for (; drawn_waypoints < count; drawn_waypoints++)
     {
+        const auto &waypoint = frame.waypoints[drawn_waypoints];
 
-        float nx = lx + std::cos(heading) * forward_factor * waypoint.f;
-        float ny = ly + std::sin(heading) * forward_factor * waypoint.f;
-
-        if (i++ % GUI_SKIP == 0)
-            SDL_RenderDrawLine(renderer, lx, ly, nx, ny);
+        track_end.x += std::cos(track_heading) * forward_factor * waypoint.f;
+        track_end.y += std::sin(track_heading) * forward_factor * waypoint.f;
+        track_heading += waypoint.a * angle_factor;
 
-        lx = nx;
-        ly = ny;
-        heading += waypoint.a * angle_factor;
+        if (drawn_waypoints % GUI_SKIP == 0)
+            points.push_back(track_end);
     }
+
+    SDL_SetRenderDrawColor(renderer, 100, 100, 100, 255);
+    SDL_RenderDrawLinesF(renderer, points.data(), points.size());
 }
 
 void HingyTrackGui::DrawBounds()
@@ -492,7 +1360,7 @@ void HingyTrackGui::DrawBounds()
     if (bounds.size() == 0)
         return;
 
-    auto &last_bound = bounds[0];
+    auto last_bound = bounds[0];
 
     for (const auto &bound : bounds)
     {
@@ -511,37 +1379,58 @@ void HingyTrackGui::DrawBounds()
     }
 }
 
-void HingyTrackGui::DrawHinges()
+void HingyTrackGui::DrawHinges(const Frame &frame)
 {
-    SDL_SetRenderDrawColor(renderer, 0, 160, 0, 255);
+    int count = frame.hinges.size();
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
 
-    if (hinges.size() == 0)
+    if (count == 0)
         return;
 
-    auto last_hinge = hinges[hinges.size() - 1];
+    // One call for all of them: every hinge is a one pixel wide quad, coloured
+    // by its desired speed.
+    auto last_pos = frame.hinges[count - 1];
 
-    for (const auto &hinge : hinges)
+    for (int i = 0; i < count; i++)
     {
-        auto my_pos = hinge.ToWaypoint();
-        auto last_pos = last_hinge.ToWaypoint();
+        auto my_pos = frame.hinges[i];
+        float dx = my_pos.x - last_pos.x, dy = my_pos.y - last_pos.y;
+        float len = std::max(std::sqrt(dx * dx + dy * dy), 1e-6f);
+        float nx = -dy / len * 0.5f, ny = dx / len * 0.5f;
+        SDL_Color color = {0, (Uint8)(frame.speeds[i] * 200.0f + 50.0f), 0,
+                           255};
+        int base = vertices.size();
+
+        for (auto &pos : {last_pos, my_pos})
+        {
+            float x = pos.x + rx / 2, y = pos.y + ry / 2;
+            vertices.push_back({{x + nx, y + ny}, color, {0.0f, 0.0f}});
+            vertices.push_back({{x - nx, y - ny}, color, {0.0f, 0.0f}});
+        }
 
-        SDL_SetRenderDrawColor(renderer, 0,
-                               hinge.desired_speed * 200.0f + 50.0f, 0, 255);
-        // SDL_SetRenderDrawColor(renderer, 0, 255.0f, 0, 255);
+        indices.insert(indices.end(), {base, base + 1, base + 2, base + 1,
+                                       base + 3, base + 2});
+        last_pos = my_pos;
+    }
 
-        SDL_RenderDrawLine(renderer, my_pos.x + rx / 2, my_pos.y + ry / 2,
-                           last_pos.x + rx / 2, last_pos.y + ry / 2);
+    SDL_RenderGeometry(renderer, NULL, vertices.data(), vertices.size(),
+                       indices.data(), indices.size());
+}
 
-        last_hinge = hinge;
-    }
+void HingyTrackGui::DrawCurrentHinge(const Frame &frame, int current)
+{
+    int count = frame.hinges.size();
+
+    if (count == 0)
+        return;
 
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
 
-    SDL_RenderDrawLine(renderer,
-                       hinges[current_hinge % hinges.size()].x + rx / 2,
-                       hinges[current_hinge % hinges.size()].y + ry / 2,
-                       hinges[(current_hinge + 1) % hinges.size()].x + rx / 2,
-                       hinges[(current_hinge + 1) % hinges.size()].y + ry / 2);
+    SDL_RenderDrawLine(renderer, frame.hinges[current % count].x + rx / 2,
+                       frame.hinges[current % count].y + ry / 2,
+                       frame.hinges[(current + 1) % count].x + rx / 2,
+                       frame.hinges[(current + 1) % count].y + ry / 2);
 }
 
 void HingyTrackGui::DrawMiddle()
@@ -554,56 +1443,88 @@ void HingyTrackGui::DrawMiddle()
     SDL_RenderDrawLine(renderer, 0, ry / 2.0f, rx, ry / 2.0f);
 }
 
-void HingyTrackGui::TickGraphics(bool clear)
+void HingyTrackGui::UpdateStaticLayers(const Frame &frame)
 {
-    bool killsdl = false;
-    if (renderer == nullptr)
-        return;
+    SDL_SetRenderTarget(renderer, bitmapTex);
 
-    SDL_Event e;
-    if (SDL_PollEvent(&e))
-    {
-        if (e.type == SDL_QUIT)
-        {
-            killsdl = true;
-        }
-    }
-
-    if (clear)
+    if (frame.geometry != drawn_geometry ||
+        frame.waypoints.size() < drawn_waypoints)
     {
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
         SDL_RenderClear(renderer);
+
+        DrawMiddle();
+        // DrawBounds();
+        DrawHinges(frame);
+
+        drawn_geometry = frame.geometry;
+        drawn_waypoints = 0;
+        track_heading = HALF_PI / 2.0f;
+        track_end = {rx / 2.0f, ry / 2.0f};
     }
 
-    DrawMiddle();
-    if (recording)
-        DrawTrack();
-    // DrawBounds();
+    if (frame.recording)
+        DrawTrack(frame);
+
+    SDL_SetRenderTarget(renderer, NULL);
+}
+
+void HingyTrackGui::RenderLoop()
+{
+    // The window lives and dies on this thread, SDL wants its events pumped
+    // where the window was created.
+    SDL_Init(SDL_INIT_VIDEO);
+
+    win = SDL_CreateWindow("HingyBot", 100, 100, rx, ry, 0);
+    renderer = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED);
+    bitmapTex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+                                  SDL_TEXTUREACCESS_TARGET, rx, ry);
+    UpdateStaticLayers(frames.Front());
+    SDL_ShowWindow(win);
 
-    DrawHinges();
+    auto period = std::chrono::microseconds(1000000 / std::max(fps, 1));
+    auto next_frame = std::chrono::steady_clock::now();
 
-    if (!killsdl)
+    while (!stop)
     {
+        SDL_Event e;
+        while (SDL_PollEvent(&e))
+        {
+            if (e.type == SDL_QUIT)
+                closed = true;
+        }
+
+        if (closed)
+            break;
+
+        if (frames.Update())
+            UpdateStaticLayers(frames.Front());
+
+        // Whatever the track length, a frame is one copy and one line.
         SDL_RenderCopy(renderer, bitmapTex, NULL, NULL);
+        DrawCurrentHinge(frames.Front(), shown_hinge);
         SDL_RenderPresent(renderer);
-    }
-    else
-    {
-        KillGui();
-    }
-}
 
-void HingyTrackGui::KillGui()
-{
-    if (renderer == nullptr)
-        return;
+        // A slow frame pushes the schedule back instead of being caught up.
+        next_frame = std::max(next_frame + period,
+                              std::chrono::steady_clock::now());
+        std::this_thread::sleep_until(next_frame);
+    }
 
     SDL_DestroyTexture(bitmapTex);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(win);
 
     SDL_Quit();
-    renderer = nullptr;
+}
+
+void HingyTrackGui::KillGui()
+{
+    if (!render_thread.joinable())
+        return;
+
+    stop = true;
+    render_thread.join();
     StopRecording();
 }
 
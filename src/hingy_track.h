@@ -1,19 +1,39 @@
 #pragma once
 
+#include <atomic>
+#include <climits>
+#include <future>
+#include <memory>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <vector>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_render.h>
 
+#include "diagnostics.h"
 #include "hingy_math.h"
+#include "segment_index.h"
+#include "shared_array.h"
+#include "track_snapshots.h"
+#include "track_store.h"
+#include "triple_buffer.h"
 #include "utils.h"
 
 #define THREADS_COUNT 4
+#define HINGE_SETTLE_WINDOW 500
+#define HINGE_PATCH_MARGIN 8
+#define HINGE_PATCH_HOLD 0.01f
+// What ConstructHinges() is given when preparing a track to drive.
+#define HINGE_SKIP 13
+
+class WaypointSimplifier;
 
 class HingyTrack
 {
+    friend class HingeBatch;
+
   public:
     struct Waypoint
     {
@@ -34,9 +54,11 @@ class HingyTrack
         void ClapToAxis();
     };
 
-    std::vector<Waypoint> waypoints;
-    std::vector<std::pair<Vector2D, Vector2D>> bounds;
-    std::vector<Hinge> hinges;
+    // Either built by this process or mapped from the track store, in which
+    // case they're only copied when something changes them.
+    SharedArray<Waypoint> waypoints;
+    SharedArray<std::pair<Vector2D, Vector2D>> bounds;
+    SharedArray<Hinge> hinges;
     std::string filename;
 
     float angle_factor = 0.1965f;
@@ -47,23 +69,86 @@ class HingyTrack
     float interhinge_pos;
     bool recording = false;
 
+    // Completed laps of a recording, fused into one when it stops. After
+    // the last lap that happens in the background, see FuseRecording().
+    std::vector<std::vector<Waypoint>> recorded_laps;
+    int record_laps = 1, record_threads = 0;
+    std::shared_ptr<WaypointSimplifier> simplifier;
+    std::shared_future<std::vector<Waypoint>> fused_laps;
+
     float last_forward = 0.0f;
     bool fuse, fuse2;
 
     int current_hinge = 0;
+    float speed_params[3] = {0.0f, 0.0f, 0.0f};
+
+    std::string cache_prefix;
+    std::vector<Vector2D> settle_positions;
+    int settle_calls = 0;
+
+    // Hinges whose speeds no longer follow from their curves, all of them
+    // until the first profile is built. See ConstructSpeeds().
+    int speeds_stale_first = 0, speeds_stale_last = INT_MAX;
+
+    // Built on the first snapshot after every geometry change, shared with
+    // the snapshots still waiting to be written.
+    std::shared_ptr<TrackSnapshots> snapshots;
+    std::shared_ptr<const TrackGeometry> snapshot_geometry;
+
+    // Over the ring of hinges and the two edges of the bounds, refit on the
+    // first query after a geometry change.
+    SegmentIndex hinge_index, bound_index;
+    bool indices_stale = true;
 
-    std::string tmp_filename;
+    std::shared_ptr<DiagnosticsSink> diagnostics = DiagnosticsSink::None();
+    int simulate_iterations = 0;
+
+    size_t SharedBytes() const;
+    void WriteShared(TrackStoreHeader *image) const;
+
+    void MarkSpeedsStale(int first, int last);
+    // Fuses and saves the recorded laps off the control thread, the
+    // recording ends once TakeFusedLaps() swaps them in.
+    void FuseRecording();
+    void TakeFusedLaps();
+    // Drops everything derived from the waypoints, bounds and hinges.
+    void GeometryChanged();
+    void RefitIndices();
+    // Adds the straightening and pulling forces around hinge i and updates
+    // its curve.
+    void HingeForces(int i, float straightening_factor, float pulling_factor,
+                     std::vector<Vector2D> &forces);
+    // One SimulateHinges() step that only moves the hinges in the window.
+    void RelaxHinges(float straightening_factor, float pulling_factor,
+                     const std::vector<char> &window);
 
   public:
+    // What PatchHinges() redid: the changed waypoints and the hinges
+    // relaxed around them.
+    struct Patch
+    {
+        int first_waypoint, old_waypoints, new_waypoints;
+        int relaxed, iterations;
+    };
+
     virtual ~HingyTrack(){};
-    HingyTrack(std::string filename);
+    // With a track store key, attaches to the track published under it
+    // instead of loading the file, when there is one.
+    HingyTrack(std::string filename, const std::string &shared = "");
 
     float fshift = 37.0f;
     float hinge_sep = 1.0f;
 
     bool Recording();
-    virtual void BeginRecording();
+    // Records the given number of laps and fuses them, see fuse_laps().
+    // Waypoints are simplified as they come in, see WaypointSimplifier.
+    virtual void BeginRecording(int laps = 1, int threads = 0,
+                                float tolerance = 0.0f);
     virtual void StopRecording();
+    // As XML, or compressed when the name ends with TRACK_CODEC_SUFFIX.
+    bool SaveWaypoints(const std::string &filename) const;
+    static bool SaveWaypoints(const std::string &filename,
+                              const std::vector<Waypoint> &waypoints);
     virtual void MarkWaypoint(float forward, float l, float r, float angle,
                               float speed);
     virtual void ConstructBounds();
@@ -74,29 +159,123 @@ class HingyTrack
     virtual float GetHingeSpeed();
     virtual void ConstructSpeeds(float s, float p, float c);
     virtual int GetCurrentHinge(float fwd);
+    int CurrentHinge() const;
+
+    // Reads every page of the waypoint, bound and hinge arrays so the control
+    // loop doesn't take the faults, returns the bytes covered.
+    size_t Prefault() const;
+
+    const SharedArray<Waypoint> &GetWaypoints() const;
+    float GetWaypointCurvature(const Waypoint &waypoint) const;
 
-    void CacheHinges();
-    bool LoadHingesFromCache();
+    // Relaxed hinges are cached per force pair. Loading takes the entry with
+    // the nearest forces and tells whether they were the same, otherwise
+    // the hinges are only a starting point for relaxing with these forces.
+    uint64_t TrackHash() const;
+    std::string CacheEntry(float force1, float force2) const;
+    void CacheHinges(float force1, float force2);
+    bool LoadHingesFromCache(float force1, float force2, bool &exact);
+    // Checked every HINGE_SETTLE_WINDOW calls, true once the hinges drifted
+    // less than tolerance (rms) since the previous check.
+    bool HingesSettled(float tolerance);
+
+    // For a track whose bounds and centreline hinges are constructed and
+    // which is an edit of old, a relaxed track: keeps the hinges away from
+    // the edited waypoints where old has them and relaxes only a window
+    // around the edit, with the kept ones held. Everything after the edit
+    // moves rigidly with it, so the ring's seam is relaxed too when the
+    // edit turns or shifts the end, and so are the hinges that an edit of
+    // the length moved onto other waypoints. False when most of the ring
+    // was edited.
+    bool PatchHinges(const HingyTrack &old, float straightening_factor,
+                     float pulling_factor, int iterations, float tolerance,
+                     Patch &patch);
+    // PatchHinges() from the cache entry of the same forces, when there's
+    // one for an earlier version of the track.
+    bool PatchHingesFromCache(float force1, float force2, int iterations,
+                              float tolerance, Patch &patch);
+
+    // Maps the waypoints, bounds, hinges and speed profile published under
+    // the key (see TrackStore), false if there's nothing there.
+    bool AttachShared(const std::string &key);
+    bool AttachShared(std::shared_ptr<const TrackStoreHeader> image);
+    // Publishes them under the key and switches to the shared copy. False if
+    // another process published first or the store is unavailable.
+    bool PublishShared(const std::string &key);
+    bool Shared() const;
+
+    // The same image as a file, for AttachShared(TrackStore::Load()).
+    bool SaveArtifact(const std::string &filename) const;
+
+    // Position queries, in the coordinates of GetGeometry(). Edge i runs
+    // from hinge i to the next one round the ring, the bounds are crossed
+    // at the waypoints whose left or right edge to the next waypoint is
+    // crossed. -1 or nothing without hinges.
+    int NearestHinge(Vector2D point);
+    int NearestEdge(Vector2D point);
+    std::vector<int> CrossedEdges(Vector2D a, Vector2D b);
+    std::vector<int> CrossedBounds(Vector2D a, Vector2D b);
+
+    TrackGeometry GetGeometry() const;
+    void AttachSnapshots(std::shared_ptr<TrackSnapshots> snapshots);
+    void SetDiagnostics(std::shared_ptr<DiagnosticsSink> diagnostics);
+    std::shared_ptr<DiagnosticsSink> GetDiagnostics();
+    // Queues an offscreen render of the track as <name>_<index>.png, no-op
+    // without attached snapshots.
+    void Snapshot(const std::string &name, int index);
 };
 
+// Draws the track on its own thread, so the control loop only pays for
+// copying the geometry when it changes. The control thread publishes frames
+// through a triple buffer and the current hinge through an atomic. Static
+// layers are kept in bitmapTex and only redrawn when the geometry changes,
+// recorded waypoints are appended to it as they arrive.
 class HingyTrackGui : public HingyTrack
 {
-    int rx, ry;
+    struct Frame
+    {
+        std::vector<Vector2D> hinges;
+        std::vector<float> speeds;
+        std::vector<Waypoint> waypoints;
+        bool recording = false;
+        int geometry = 0, lap = 0;
+    };
+
+    int rx, ry, fps;
+    int geometry = 0;
 
     SDL_Window *win = NULL;
     SDL_Renderer *renderer = NULL;
     SDL_Texture *bitmapTex = NULL;
     SDL_Surface *bitmapSurface = NULL;
 
-  public:
-    void DrawTrack();
+    TripleBuffer<Frame> frames;
+    std::atomic<int> shown_hinge{0};
+    std::atomic<bool> stop{false}, closed{false};
+    std::thread render_thread;
+
+    // Render thread's progress on the cached layers.
+    int drawn_geometry = -1, drawn_waypoints = 0;
+    float track_heading;
+    SDL_FPoint track_end;
+
+    void DrawTrack(const Frame &frame);
     void DrawBounds();
-    void DrawHinges();
+    void DrawHinges(const Frame &frame);
+    void DrawCurrentHinge(const Frame &frame, int current);
     void DrawMiddle();
-    void TickGraphics(bool clear = true);
+    void UpdateStaticLayers(const Frame &frame);
+    void RenderLoop();
 
+  public:
     virtual ~HingyTrackGui();
-    HingyTrackGui(std::string filename, int resx, int resy);
+    HingyTrackGui(std::string filename, int resx, int resy, int fps = 30,
+                  const std::string &shared = "");
+
+    // Hands the current geometry over to the render thread. Cheap to call
+    // often: unless forced, nothing is copied while the previous frame is
+    // still waiting to be drawn, and recorded waypoints are only appended.
+    void PublishFrame(bool force = true);
 
     virtual void MarkWaypoint(float forward, float l, float r, float angle,
                               float speed);
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <cmath>
+
+#include "kinematic_integration.h"
+
+// Roughly TORCS' car1-trb1, enough to make gear changes and grip limits
+// matter to the driver.
+#define SIM_MASS 1150.0f
+#define SIM_WHEELBASE 2.6f
+#define SIM_AXLE_TRACK 1.6f
+#define SIM_WHEEL_RADIUS 0.33f
+#define SIM_STEER_LOCK 0.366f
+#define SIM_ENGINE_TORQUE 400.0f
+#define SIM_REDLINE 9500.0f
+#define SIM_IDLE_RPM 1000.0f
+#define SIM_DIFF_RATIO 4.5f
+#define SIM_BRAKE_DECEL 12.0f
+#define SIM_DRAG 6e-4f
+#define SIM_ROLLING 0.1f
+#define SIM_GRASS_DRAG 0.5f
+#define SIM_GRIP 1.2f
+#define SIM_GRASS_GRIP 0.6f
+#define SIM_DOWNFORCE 2.4e-3f
+#define SIM_G 9.81f
+
+const float gear_ratios[] = {-2.0f, 0.0f, 3.82f, 2.15f, 1.56f,
+                             1.21f, 0.97f, 0.83f};
+
+inline float ratio_of(int gear) { return gear_ratios[gear + 1]; }
+
+// Like TORCS, inputs out of range are clamped and garbage is ignored.
+inline float clamp_input(float value, float min, float max)
+{
+    if (!std::isfinite(value))
+        return 0.0f;
+
+    return std::max(min, std::min(value, max));
+}
+
+// The driven track, unless the driver is to find out which it is.
+KinematicIntegration::KinematicIntegration(stringmap params)
+    : KinematicIntegration(params,
+                           HingyTrack(params["sim_track"] != ""
+                                          ? params["sim_track"]
+                                          : params["track"]))
+{
+}
+
+KinematicIntegration::KinematicIntegration(stringmap params,
+                                           const HingyTrack &track)
+{
+    dt = std::stof(params["sim_dt"]);
+    max_time = std::stof(params["sim_time"]);
+    max_laps = std::stoi(params["sim_laps"]);
+    half_width = std::stof(params["sim_track_width"]) / 2.0f;
+    track_offset = std::stof(params["sim_track_offset"]);
+
+    for (const auto &waypoint : track.GetWaypoints())
+    {
+        odometers.push_back(lap_length);
+        curvatures.push_back(track.GetWaypointCurvature(waypoint));
+        lap_length += waypoint.f;
+    }
+
+    if (curvatures.size() == 0)
+        log_error("The kinematic simulator needs a recorded track!");
+}
+
+float KinematicIntegration::GetCurvature(float odometer)
+{
+    float pos = std::fmod(odometer - track_offset + lap_length, lap_length);
+
+    // Waypoints are walked incrementally, the search is only for jumps.
+    if (pos < odometers[waypoint])
+        waypoint = std::upper_bound(odometers.begin(), odometers.end(), pos) -
+                   odometers.begin() - 1;
+
+    while (waypoint + 1 < odometers.size() && odometers[waypoint + 1] <= pos)
+        waypoint++;
+
+    return curvatures[std::max(waypoint, 0)];
+}
+
+float KinematicIntegration::GetRpm()
+{
+    float rpm = std::abs(v) / SIM_WHEEL_RADIUS * ratio_of(gear) *
+                SIM_DIFF_RATIO * 60.0f / (2.0f * PI);
+
+    return std::max(std::abs(rpm), SIM_IDLE_RPM);
+}
+
+CarState KinematicIntegration::GetCarState()
+{
+    CarState state;
+    float half_track = yaw_rate * SIM_AXLE_TRACK / 2.0f;
+
+    state.absolute_odometer = s;
+    state.cross_position = n / half_width;
+    state.angle = -psi;
+    state.current_lap_time = lap_time;
+    state.rpm = GetRpm();
+    state.speed_x = v * std::cos(psi) * 3.6f;
+    state.speed_y = v * std::sin(psi) * 3.6f;
+    state.height = 0.33f;
+    state.gear = gear;
+
+    // TORCS order: front right, front left, rear right, rear left.
+    state.wheels_speeds = {{(v + half_track) / SIM_WHEEL_RADIUS,
+                            (v - half_track) / SIM_WHEEL_RADIUS,
+                            (v + half_track) / SIM_WHEEL_RADIUS,
+                            (v - half_track) / SIM_WHEEL_RADIUS}};
+    state.sensors.fill(200.0f);
+
+    return state;
+}
+
+CarState KinematicIntegration::Begin(stringmap driver_params)
+{
+    return GetCarState();
+}
+
+CarState KinematicIntegration::Cycle(const CarSteers &steers)
+{
+    float steer = clamp_input(steers.steering_wheel, -1.0f, 1.0f);
+    float gas = clamp_input(steers.gas, 0.0f, 1.0f);
+    float brake = clamp_input(steers.hand_brake, 0.0f, 1.0f);
+    bool offtrack = std::abs(n) > half_width;
+    float grip = (offtrack ? SIM_GRASS_GRIP : SIM_GRIP) * SIM_G +
+                 (offtrack ? 0.0f : SIM_DOWNFORCE * v * v);
+
+    gear = std::max(-1, std::min(steers.gear, 6));
+
+    // Lateral: kinematic yaw rate, saturated at the grip limit.
+    yaw_rate = v * std::tan(steer * SIM_STEER_LOCK) / SIM_WHEELBASE;
+    if (std::abs(v * yaw_rate) > grip)
+        yaw_rate = std::copysign(grip / std::abs(v), yaw_rate);
+    float lateral = v * yaw_rate;
+
+    // Longitudinal: engine through the gearbox and brakes share what's left
+    // of the friction circle, drag and rolling resistance don't.
+    float traction = 0.0f;
+    if (steers.clutch < 0.5f && gear != 0)
+    {
+        float rpm = GetRpm();
+        float torque = SIM_ENGINE_TORQUE *
+                       std::max(0.0f, 1.0f - std::max(0.0f, rpm - SIM_REDLINE) /
+                                                 500.0f);
+        traction = gas * torque * ratio_of(gear) * SIM_DIFF_RATIO /
+                   SIM_WHEEL_RADIUS / SIM_MASS;
+    }
+    traction -= std::copysign(brake * SIM_BRAKE_DECEL, v);
+
+    float traction_limit =
+        std::sqrt(std::max(grip * grip - lateral * lateral, 0.0f));
+    traction = std::max(-traction_limit, std::min(traction, traction_limit));
+
+    float resistance = SIM_DRAG * v * std::abs(v) +
+                       std::copysign(SIM_ROLLING, v) +
+                       (offtrack ? SIM_GRASS_DRAG * v : 0.0f);
+
+    float new_v = v + (traction - resistance) * dt;
+    if (brake > 0.0f && new_v * v < 0.0f)
+        new_v = 0.0f;
+    v = new_v;
+
+    // Kinematics in track coordinates.
+    float k = GetCurvature(s);
+    float s_dot = v * std::cos(psi) / (1.0f - n * k);
+
+    n += v * std::sin(psi) * dt;
+    psi += (yaw_rate - k * s_dot) * dt;
+    psi = std::remainder(psi, 2.0f * PI);
+
+    // Barriers: hitting one halves the speed and turns the car along it.
+    if (std::abs(n) > half_width * 1.5f)
+    {
+        n = std::copysign(half_width * 1.5f, n);
+
+        if (v * std::sin(psi) * n > 0.0f)
+        {
+            psi = 0.0f;
+            v /= 2.0f;
+        }
+    }
+
+    s += s_dot * dt;
+    distance += s_dot * dt;
+    time += dt;
+    lap_time += dt;
+
+    if (offtrack)
+        offtrack_time += dt;
+
+    if (s >= lap_length)
+    {
+        s -= lap_length;
+        lap_time = 0.0f;
+        laps++;
+    }
+    else if (s < 0.0f)
+    {
+        s += lap_length;
+    }
+
+    return GetCarState();
+}
+
+bool KinematicIntegration::Finished()
+{
+    return laps >= max_laps || time >= max_time;
+}
+
+float KinematicIntegration::Score()
+{
+    if (time <= 0.0f)
+        return 0.0f;
+
+    // Average speed along the track, discounted by the share of time spent
+    // off it.
+    return distance / time * (1.0f - offtrack_time / time);
+}
+
+int KinematicIntegration::Laps() { return laps; }
+
+float KinematicIntegration::Time() { return time; }
+
+KinematicIntegration::~KinematicIntegration() {}
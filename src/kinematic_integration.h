@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "car_io.h"
+#include "hingy_track.h"
+#include "main.h"
+#include "torcs_integration.h"
+
+// Headless stand-in for TORCS: a kinematic bicycle model driven along the
+// curvature of a recorded track, in track coordinates (odometer, lateral
+// offset, heading relative to the track axis). Much cruder than TORCS, meant
+// for screening parameter sets before spending simulator time on them.
+class KinematicIntegration : public SimIntegration
+{
+    std::vector<float> curvatures, odometers;
+    float lap_length = 0.0f, track_offset, half_width;
+
+    float dt, max_time;
+    int max_laps;
+
+    // Car state in track coordinates, SI units.
+    float s = 0.0f, n = 0.0f, psi = 0.0f, v = 0.0f, yaw_rate = 0.0f;
+    float time = 0.0f, lap_time = 0.0f, offtrack_time = 0.0f;
+    float distance = 0.0f;
+    int gear = 1, laps = 0, waypoint = 0;
+
+    float GetCurvature(float odometer);
+    float GetRpm();
+    CarState GetCarState();
+
+  public:
+    virtual CarState Begin(stringmap driver_params) override;
+    virtual CarState Cycle(const CarSteers &) override;
+    virtual bool Finished() override;
+
+    float Score();
+    int Laps();
+    float Time();
+
+    KinematicIntegration(stringmap params);
+    KinematicIntegration(stringmap params, const HingyTrack &track);
+    virtual ~KinematicIntegration();
+};
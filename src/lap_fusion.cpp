@@ -0,0 +1,140 @@
+#include <algorithm>
+
+#include "lap_fusion.h"
+#include "thread_pool.h"
+
+using Waypoint = HingyTrack::Waypoint;
+
+// Odometer and accumulated heading at the start of every waypoint of a lap,
+// one more entry for its end.
+struct LapProfile
+{
+    const std::vector<Waypoint> *waypoints;
+    std::vector<float> start, heading;
+
+    float Length() const { return start.back(); }
+
+    // Heading accumulated by the given odometer, interpolated within the
+    // waypoint. The cursor only moves forward, so walking a lap is linear.
+    float HeadingAt(float odometer, size_t &cursor) const
+    {
+        while (cursor + 1 < waypoints->size() && start[cursor + 1] <= odometer)
+            cursor++;
+
+        const Waypoint &waypoint = (*waypoints)[cursor];
+        float into = waypoint.f > 0.0f
+                         ? (odometer - start[cursor]) / waypoint.f
+                         : 0.0f;
+        return heading[cursor] +
+               waypoint.a * std::min(std::max(into, 0.0f), 1.0f);
+    }
+};
+
+static float median(std::vector<float> &values)
+{
+    size_t half = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + half, values.end());
+    float upper = values[half];
+
+    if (values.size() % 2 != 0)
+        return upper;
+
+    return (*std::max_element(values.begin(), values.begin() + half) + upper) /
+           2.0f;
+}
+
+std::vector<Waypoint>
+fuse_laps(const std::vector<std::vector<Waypoint>> &laps, int threads)
+{
+    std::vector<LapProfile> profiles;
+
+    for (auto &lap : laps)
+    {
+        LapProfile profile{&lap, {0.0f}, {0.0f}};
+
+        for (auto &waypoint : lap)
+        {
+            profile.start.push_back(profile.start.back() + waypoint.f);
+            profile.heading.push_back(profile.heading.back() + waypoint.a);
+        }
+
+        if (lap.size() > 1 && profile.Length() > 0.0f)
+            profiles.push_back(std::move(profile));
+    }
+
+    if (profiles.size() == 0)
+        return {};
+    if (profiles.size() == 1)
+        return *profiles[0].waypoints;
+
+    std::vector<float> lengths;
+    for (auto &profile : profiles)
+        lengths.push_back(profile.Length());
+
+    std::vector<float> sorted = lengths;
+    float length = median(sorted);
+    const LapProfile &reference =
+        profiles[std::min_element(lengths.begin(), lengths.end(),
+                                  [&](float a, float b) {
+                                      return std::abs(a - length) <
+                                             std::abs(b - length);
+                                  }) -
+                 lengths.begin()];
+
+    // Where each waypoint starts, as a share of the lap.
+    size_t count = reference.waypoints->size();
+    std::vector<float> share(count + 1);
+    for (size_t j = 0; j <= count; j++)
+        share[j] = reference.start[j] / reference.Length();
+    share[count] = 1.0f;
+
+    std::vector<Waypoint> fused(count);
+    std::vector<std::function<void()>> tasks;
+
+    for (size_t begin = 0; begin < count; begin += FUSION_SEGMENT)
+    {
+        size_t end = std::min(begin + FUSION_SEGMENT, count);
+
+        tasks.push_back([&, begin, end]() {
+            size_t laps = profiles.size();
+            std::vector<size_t> cursors(laps);
+            std::vector<float> headings(laps), turns(laps), lefts(laps),
+                rights(laps);
+
+            for (size_t k = 0; k < laps; k++)
+            {
+                const LapProfile &lap = profiles[k];
+                float odometer = share[begin] * lap.Length();
+
+                cursors[k] = std::upper_bound(lap.start.begin(),
+                                              lap.start.end() - 1, odometer) -
+                             lap.start.begin() - 1;
+                headings[k] = lap.HeadingAt(odometer, cursors[k]);
+            }
+
+            for (size_t j = begin; j < end; j++)
+            {
+                for (size_t k = 0; k < laps; k++)
+                {
+                    const LapProfile &lap = profiles[k];
+                    const Waypoint &waypoint = (*lap.waypoints)[cursors[k]];
+                    float heading =
+                        lap.HeadingAt(share[j + 1] * lap.Length(), cursors[k]);
+
+                    lefts[k] = waypoint.l;
+                    rights[k] = waypoint.r;
+                    turns[k] = heading - headings[k];
+                    headings[k] = heading;
+                }
+
+                fused[j].f = (share[j + 1] - share[j]) * length;
+                fused[j].a = median(turns);
+                fused[j].l = median(lefts);
+                fused[j].r = median(rights);
+            }
+        });
+    }
+
+    WorkStealingPool(threads).Run(std::move(tasks));
+    return fused;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+
+#include "hingy_track.h"
+
+// Waypoints fused per task, each task walks every lap once from its start.
+#define FUSION_SEGMENT 512
+
+// Fuses laps recorded over the same line into one. The laps are aligned by
+// odometer and scaled to the median lap length, then every waypoint of the
+// fused lap takes the median over the laps of the heading change and track
+// position across its stretch, so a lap with a slip or an odometer glitch
+// there is outvoted. The waypoints follow the lap of median length, a
+// single lap comes back as it is.
+std::vector<HingyTrack::Waypoint>
+fuse_laps(const std::vector<std::vector<HingyTrack::Waypoint>> &laps,
+          int threads = 0);
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "latency_stats.h"
+#include "utils.h"
+
+using namespace std::chrono;
+
+LatencyStats latency_stats;
+
+const char *stage_names[STAGE_COUNT] = {"receive", "parse",  "cycle",
+                                        "track",   "encode", "send"};
+
+LatencyHistogram::LatencyHistogram() { Clear(); }
+
+void LatencyHistogram::Clear()
+{
+    for (auto &count : counts)
+        count.store(0);
+    max.store(0);
+}
+
+int LatencyHistogram::Bucket(uint64_t ns)
+{
+    if (ns < (1 << LATENCY_SUB_BITS))
+        return ns;
+
+    int magnitude = 63 - __builtin_clzll(ns);
+    int shift = magnitude - LATENCY_SUB_BITS;
+
+    return ((shift + 1) << LATENCY_SUB_BITS) +
+           (ns >> shift) - (1 << LATENCY_SUB_BITS);
+}
+
+uint64_t LatencyHistogram::BucketTop(int bucket)
+{
+    if (bucket < (1 << LATENCY_SUB_BITS))
+        return bucket;
+
+    int shift = (bucket >> LATENCY_SUB_BITS) - 1;
+    uint64_t sub = bucket & ((1 << LATENCY_SUB_BITS) - 1);
+
+    return (((1 << LATENCY_SUB_BITS) + sub + 1) << shift) - 1;
+}
+
+uint64_t LatencyHistogram::Percentile(const std::vector<uint64_t> &counts,
+                                      double p)
+{
+    uint64_t total = 0, seen = 0;
+
+    for (auto count : counts)
+        total += count;
+
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = std::max<uint64_t>(1, std::ceil(p * total));
+
+    for (int bucket = 0; bucket < counts.size(); bucket++)
+    {
+        seen += counts[bucket];
+        if (seen >= rank)
+            return BucketTop(bucket);
+    }
+
+    return BucketTop(counts.size() - 1);
+}
+
+void LatencyHistogram::Read(std::vector<uint64_t> &out, uint64_t &max_ns)
+{
+    out.resize(LATENCY_BUCKETS);
+
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+        out[bucket] = counts[bucket].load(std::memory_order_relaxed);
+
+    max_ns = max.load(std::memory_order_relaxed);
+}
+
+void LatencyStats::Report(bool final)
+{
+    auto now = steady_clock::now();
+    double seconds =
+        duration<double>(now - (final ? start_time : last_report)).count();
+    std::string line = std::string("{\"type\":\"") +
+                       (final ? "latency_total" : "latency") +
+                       "\",\"mode\":\"" + mode +
+                       "\",\"window_s\":" + std::to_string(seconds);
+
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        std::vector<uint64_t> counts;
+        uint64_t max_ns, total = 0;
+
+        stages[stage].Read(counts, max_ns);
+        auto window = counts;
+
+        // Interval reports cover what was recorded since the previous one,
+        // their max is the top of the highest bucket hit.
+        if (!final)
+        {
+            last_counts[stage].resize(LATENCY_BUCKETS);
+            for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+                window[bucket] -= last_counts[stage][bucket];
+            last_counts[stage] = counts;
+            max_ns = LatencyHistogram::Percentile(window, 1.0);
+        }
+
+        for (auto count : window)
+            total += count;
+
+        char buf[256];
+        snprintf(buf, sizeof(buf),
+                 "%s\"%s\":{\"count\":%lu,\"per_s\":%.1f,\"p50_us\":%.3f,"
+                 "\"p99_us\":%.3f,\"p999_us\":%.3f,\"max_us\":%.3f}",
+                 stage == 0 ? ",\"stages\":{" : ",", stage_names[stage],
+                 (unsigned long)total, seconds > 0.0 ? total / seconds : 0.0,
+                 LatencyHistogram::Percentile(window, 0.5) / 1e3,
+                 LatencyHistogram::Percentile(window, 0.99) / 1e3,
+                 LatencyHistogram::Percentile(window, 0.999) / 1e3,
+                 max_ns / 1e3);
+        line += buf;
+    }
+
+    fprintf(out, "%s}}\n", line.c_str());
+    fflush(out);
+
+    last_report = now;
+}
+
+void LatencyStats::ReporterLoop()
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    while (!wakeup.wait_for(guard, milliseconds(interval_ms),
+                            [this]() { return stop; }))
+        Report(false);
+}
+
+void LatencyStats::Start(std::string filename, int interval_ms,
+                         std::string mode)
+{
+    out = filename == "" ? stdout : fopen(filename.c_str(), "w");
+    if (out == NULL)
+        log_error("Couldn't open " + filename + " for the latency stats!");
+
+    this->interval_ms = interval_ms;
+    this->mode = mode;
+    start_time = last_report = steady_clock::now();
+    running = true;
+
+    if (interval_ms > 0)
+        reporter = std::thread(&LatencyStats::ReporterLoop, this);
+
+    // The totals are printed however the process ends, log_error included.
+    std::atexit([]() { latency_stats.Stop(); });
+}
+
+void LatencyStats::Reset()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        stages[stage].Clear();
+        last_counts[stage].clear();
+    }
+
+    start_time = last_report = steady_clock::now();
+}
+
+void LatencyStats::Stop()
+{
+    if (!running)
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+
+    wakeup.notify_one();
+    if (reporter.joinable())
+        reporter.join();
+
+    Report(true);
+    running = false;
+
+    if (out != stdout)
+        fclose(out);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum LatencyStage
+{
+    STAGE_RECEIVE, // waiting for the simulator's next state
+    STAGE_PARSE,
+    STAGE_CYCLE, // Driver::Cycle as a whole
+    STAGE_TRACK, // hinge lookups inside the cycle
+    STAGE_ENCODE,
+    STAGE_SEND,
+    STAGE_COUNT
+};
+
+// Log-linear buckets, HDR style: 16 linear steps per power of two, so any
+// value is off by at most 1/16. Recording is one relaxed increment, reading
+// copies the counts out while writers carry on.
+#define LATENCY_SUB_BITS 4
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+class LatencyHistogram
+{
+    std::atomic<uint64_t> counts[LATENCY_BUCKETS];
+    std::atomic<uint64_t> max;
+
+  public:
+    LatencyHistogram();
+
+    static int Bucket(uint64_t ns);
+    static uint64_t BucketTop(int bucket);
+    static uint64_t Percentile(const std::vector<uint64_t> &counts, double p);
+
+    void Record(uint64_t ns)
+    {
+        counts[Bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t seen = max.load(std::memory_order_relaxed);
+        while (ns > seen &&
+               !max.compare_exchange_weak(seen, ns, std::memory_order_relaxed))
+            ;
+    }
+
+    void Read(std::vector<uint64_t> &out, uint64_t &max_ns);
+    void Clear();
+};
+
+// One histogram per stage and a thread that prints them as JSON lines, every
+// interval for the interval just gone and once at exit for the whole run.
+class LatencyStats
+{
+    LatencyHistogram stages[STAGE_COUNT];
+
+    std::vector<uint64_t> last_counts[STAGE_COUNT];
+    std::chrono::steady_clock::time_point start_time, last_report;
+
+    FILE *out = NULL;
+    std::string mode;
+    int interval_ms = 0;
+    std::mutex lock;
+    std::condition_variable wakeup;
+    bool stop = false, running = false;
+    std::thread reporter;
+
+    void Report(bool final);
+    void ReporterLoop();
+
+  public:
+    void Record(LatencyStage stage, uint64_t ns) { stages[stage].Record(ns); }
+
+    // Every line carries the mode, so runs under different settings can be
+    // told apart.
+    void Start(std::string filename, int interval_ms,
+               std::string mode = "normal");
+    // Drops everything recorded so far, warm-up and handshake included, and
+    // restarts the clock.
+    void Reset();
+    void Stop();
+};
+
+extern LatencyStats latency_stats;
+
+// Times its own scope into the given stage.
+class LatencyTimer
+{
+    LatencyStage stage;
+    std::chrono::steady_clock::time_point start;
+
+  public:
+    LatencyTimer(LatencyStage stage)
+        : stage(stage), start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~LatencyTimer()
+    {
+        latency_stats.Record(
+            stage, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count());
+    }
+};
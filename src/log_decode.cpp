@@ -0,0 +1,86 @@
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "logger.h"
+
+// Turns a log written with log_binary:<file> back into text, each line
+// prefixed with the seconds since the logger started.
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <binary log>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    char magic[6];
+
+    if (f == NULL || fread(magic, 6, 1, f) != 1 ||
+        memcmp(magic, "HLOG1\n", 6) != 0)
+    {
+        fprintf(stderr, "%s isn't a binary log\n", argv[1]);
+        return 1;
+    }
+
+    std::map<uint32_t, std::pair<LogLevel, std::string>> formats;
+    int kind;
+
+    while ((kind = fgetc(f)) != EOF)
+    {
+        if (kind == 'D')
+        {
+            uint32_t id;
+            uint8_t level;
+            uint16_t length;
+
+            if (fread(&id, 4, 1, f) != 1 || fread(&level, 1, 1, f) != 1 ||
+                fread(&length, 2, 1, f) != 1)
+                break;
+
+            std::string format(length, '\0');
+            if (length > 0 && fread(&format[0], length, 1, f) != 1)
+                break;
+
+            formats[id] = {(LogLevel)level, format};
+        }
+        else if (kind == 'R')
+        {
+            char record[LOG_MAX_RECORD];
+            uint16_t size;
+            uint32_t id;
+            uint64_t ns;
+
+            if (fread(record, 2, 1, f) != 1)
+                break;
+            memcpy(&size, record, 2);
+            if (size < 14 || size > LOG_MAX_RECORD ||
+                fread(record + 2, size - 2, 1, f) != 1)
+                break;
+
+            memcpy(&id, record + 2, 4);
+            memcpy(&ns, record + 6, 8);
+
+            if (formats.find(id) == formats.end())
+            {
+                fprintf(stderr, "Record with an undefined format %u\n", id);
+                return 1;
+            }
+
+            auto &format = formats[id];
+            printf("%12.6f %s%s\n", ns / 1e9, Logger::LevelPrefix(format.first),
+                   Logger::FormatRecord(format.second, record + 14, size - 14)
+                       .c_str());
+        }
+        else
+        {
+            fprintf(stderr, "Corrupt log, unknown entry '%c'\n", kind);
+            return 1;
+        }
+    }
+
+    fclose(f);
+    return 0;
+}
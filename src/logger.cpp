@@ -0,0 +1,369 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "logger.h"
+
+using std::string;
+using namespace std::chrono;
+
+#define LOG_POLL_MS 1
+#define LOG_BINARY_MAGIC "HLOG1\n"
+
+// === Ring ===
+
+bool LogRing::Push(const char *data, size_t size)
+{
+    uint64_t h = head.load(std::memory_order_relaxed);
+    uint64_t t = tail.load(std::memory_order_acquire);
+
+    if (LOG_RING_SIZE - (h - t) < size)
+        return false;
+
+    size_t pos = h % LOG_RING_SIZE;
+    size_t first = std::min(size, LOG_RING_SIZE - pos);
+
+    memcpy(&buffer[pos], data, first);
+    memcpy(&buffer[0], data + first, size - first);
+
+    head.store(h + size, std::memory_order_release);
+    return true;
+}
+
+size_t LogRing::Peek(char *out, size_t max)
+{
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    uint64_t h = head.load(std::memory_order_acquire);
+    uint16_t size;
+
+    if (h == t)
+        return 0;
+
+    auto copy = [&](char *to, size_t offset, size_t count) {
+        size_t pos = (t + offset) % LOG_RING_SIZE;
+        size_t first = std::min(count, LOG_RING_SIZE - pos);
+
+        memcpy(to, &buffer[pos], first);
+        memcpy(to + first, &buffer[0], count - first);
+    };
+
+    copy((char *)&size, 0, 2);
+    copy(out, 0, std::min<size_t>(size, max));
+    return size;
+}
+
+void LogRing::Pop(size_t size)
+{
+    tail.store(tail.load(std::memory_order_relaxed) + size,
+               std::memory_order_release);
+}
+
+bool LogRing::Empty()
+{
+    return head.load(std::memory_order_acquire) ==
+           tail.load(std::memory_order_relaxed);
+}
+
+// === Logger ===
+
+Logger::Logger() : start_time(steady_clock::now())
+{
+    writer = std::thread(&Logger::WriterLoop, this);
+}
+
+Logger &Logger::Get()
+{
+    static Logger *logger = []() {
+        auto logger = new Logger();
+        std::atexit([]() { Logger::Get().Shutdown(); });
+        return logger;
+    }();
+
+    return *logger;
+}
+
+int Logger::Register(LogLevel level, const char *format)
+{
+    std::lock_guard<std::mutex> guard(formats_lock);
+
+    formats.push_back({level, format});
+    return formats.size() - 1;
+}
+
+LogRing &Logger::ThreadRing()
+{
+    thread_local std::shared_ptr<LogRing> ring;
+
+    if (!ring)
+    {
+        ring = std::make_shared<LogRing>();
+
+        std::lock_guard<std::mutex> guard(rings_lock);
+        rings.push_back(ring);
+    }
+
+    return *ring;
+}
+
+void Logger::Commit(const char *record, size_t size)
+{
+    uint64_t ns =
+        duration_cast<nanoseconds>(steady_clock::now() - start_time).count();
+    memcpy((char *)record + 6, &ns, 8);
+
+    if (!ThreadRing().Push(record, size))
+        dropped++;
+}
+
+void Logger::WriteFormats()
+{
+    for (; formats_written < formats.size(); formats_written++)
+    {
+        uint32_t id = formats_written;
+        uint8_t level = formats[id].level;
+        uint16_t length = formats[id].format.size();
+
+        fputc('D', binary);
+        fwrite(&id, 4, 1, binary);
+        fwrite(&level, 1, 1, binary);
+        fwrite(&length, 2, 1, binary);
+        fwrite(formats[id].format.data(), length, 1, binary);
+    }
+}
+
+void Logger::Output(const char *record, size_t size)
+{
+    uint32_t id;
+    memcpy(&id, record + 2, 4);
+
+    formats_lock.lock();
+    Format format = formats[id];
+    // Registered after this drain wrote the definitions.
+    if (binary != NULL && id >= formats_written)
+        WriteFormats();
+    formats_lock.unlock();
+
+    if (binary != NULL)
+    {
+        fputc('R', binary);
+        fwrite(record, size, 1, binary);
+
+        // Binary mode keeps warnings and errors on the terminal as well.
+        if (format.level == LEVEL_INFO)
+            return;
+    }
+
+    fprintf(format.level == LEVEL_INFO ? stdout : stderr, "%s%s\n",
+            LevelPrefix(format.level),
+            FormatRecord(format.format, record + 14, size - 14).c_str());
+}
+
+void Logger::Drain()
+{
+    std::lock_guard<std::mutex> guard(drain_lock);
+    std::vector<std::shared_ptr<LogRing>> current;
+    char record[LOG_MAX_RECORD];
+    size_t size;
+
+    if (binary != NULL)
+    {
+        std::lock_guard<std::mutex> formats_guard(formats_lock);
+        WriteFormats();
+    }
+
+    {
+        std::lock_guard<std::mutex> rings_guard(rings_lock);
+        current = rings;
+    }
+
+    for (auto &ring : current)
+    {
+        while ((size = ring->Peek(record, LOG_MAX_RECORD)) > 0)
+        {
+            Output(record, size);
+            ring->Pop(size);
+        }
+    }
+
+    // Rings of threads that are gone can go once they're empty.
+    {
+        std::lock_guard<std::mutex> rings_guard(rings_lock);
+        current.clear();
+
+        for (int i = rings.size() - 1; i >= 0; i--)
+            if (rings[i].use_count() == 1 && rings[i]->Empty())
+                rings.erase(rings.begin() + i);
+    }
+
+    uint64_t lost = dropped.exchange(0);
+    if (lost > 0)
+        fprintf(stderr, "%sDropped %lu log record(s), a ring was full\n",
+                LevelPrefix(LEVEL_WARNING), (unsigned long)lost);
+
+    fflush(stdout);
+    fflush(stderr);
+    if (binary != NULL)
+        fflush(binary);
+}
+
+void Logger::WriterLoop()
+{
+    std::unique_lock<std::mutex> guard(wakeup_lock);
+
+    while (!wakeup.wait_for(guard, milliseconds(LOG_POLL_MS),
+                            [this]() { return stop; }))
+        Drain();
+}
+
+void Logger::Flush() { Drain(); }
+
+void Logger::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> guard(wakeup_lock);
+        if (stop)
+            return;
+        stop = true;
+    }
+
+    wakeup.notify_one();
+    writer.join();
+    Drain();
+
+    if (binary != NULL)
+        fclose(binary);
+    binary = NULL;
+}
+
+bool Logger::OpenBinary(string filename)
+{
+    std::lock_guard<std::mutex> guard(drain_lock);
+
+    binary = fopen(filename.c_str(), "wb");
+    if (binary == NULL)
+        return false;
+
+    fwrite(LOG_BINARY_MAGIC, strlen(LOG_BINARY_MAGIC), 1, binary);
+    formats_written = 0;
+    return true;
+}
+
+const char *Logger::LevelPrefix(LogLevel level)
+{
+    switch (level)
+    {
+    case LEVEL_INFO:
+        return "[INFO]\t  ";
+    case LEVEL_WARNING:
+        return "[WARNING] ";
+    default:
+        return "[ERROR]   ";
+    }
+}
+
+// printf formatting with the types taken from the record rather than the
+// call site: whatever length modifiers the format has, integers are printed
+// as long long and floating point values as double.
+string Logger::FormatRecord(const string &format, const char *args,
+                            size_t size)
+{
+    const char *end = args + size;
+    string out;
+    char buf[128];
+
+    for (size_t i = 0; i < format.size(); i++)
+    {
+        if (format[i] != '%')
+        {
+            out += format[i];
+            continue;
+        }
+
+        if (i + 1 < format.size() && format[i + 1] == '%')
+        {
+            out += '%';
+            i++;
+            continue;
+        }
+
+        string spec = "%";
+        for (i++; i < format.size() && strchr("-+ #0123456789.", format[i]);
+             i++)
+            spec += format[i];
+        while (i < format.size() && strchr("hlLqjzt", format[i]))
+            i++;
+
+        if (i == format.size())
+            break;
+
+        char conversion = format[i];
+
+        if (args >= end)
+        {
+            out += "<missing>";
+            continue;
+        }
+
+        char tag = *args++;
+        int64_t i64 = 0;
+        uint64_t u64 = 0;
+        double f64 = 0.0;
+        string str;
+
+        if (tag == LOG_ARG_STRING)
+        {
+            uint16_t length;
+            memcpy(&length, args, 2);
+            str.assign(args + 2, length);
+            args += 2 + length;
+        }
+        else
+        {
+            memcpy(&i64, args, 8);
+            memcpy(&u64, args, 8);
+            memcpy(&f64, args, 8);
+            args += 8;
+
+            if (tag == LOG_ARG_DOUBLE)
+                i64 = u64 = (int64_t)f64;
+            else
+                f64 = tag == LOG_ARG_INT ? (double)i64 : (double)u64;
+
+            str = tag == LOG_ARG_DOUBLE  ? std::to_string(f64)
+                  : tag == LOG_ARG_INT ? std::to_string(i64)
+                                       : std::to_string(u64);
+        }
+
+        if (conversion == 's')
+        {
+            std::vector<char> wide(str.size() + spec.size() + 64);
+            snprintf(wide.data(), wide.size(), (spec + "s").c_str(),
+                     str.c_str());
+            out += wide.data();
+        }
+        else if (strchr("diuxXoc", conversion))
+        {
+            if (tag == LOG_ARG_STRING)
+                i64 = u64 = atoll(str.c_str());
+
+            if (conversion == 'c')
+                snprintf(buf, sizeof(buf), (spec + "c").c_str(), (int)i64);
+            else if (strchr("di", conversion))
+                snprintf(buf, sizeof(buf), (spec + "lld").c_str(),
+                         (long long)i64);
+            else
+                snprintf(buf, sizeof(buf), (spec + "ll" + conversion).c_str(),
+                         (unsigned long long)u64);
+            out += buf;
+        }
+        else
+        {
+            if (tag == LOG_ARG_STRING)
+                f64 = atof(str.c_str());
+
+            snprintf(buf, sizeof(buf), (spec + conversion).c_str(), f64);
+            out += buf;
+        }
+    }
+
+    return out;
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "main.h"
+
+enum LogLevel
+{
+    LEVEL_INFO,
+    LEVEL_WARNING,
+    LEVEL_ERROR
+};
+
+// Largest record a call may produce, longer strings are cut to fit and end
+// in LOG_TRUNCATED. log_info() and co. split them over records instead.
+#define LOG_MAX_RECORD 512
+// Longest string a record holds whole, after the header and the tag.
+#define LOG_MAX_STRING (LOG_MAX_RECORD - 14 - 3)
+#define LOG_TRUNCATED "..."
+#define LOG_RING_SIZE (1 << 16)
+
+// Argument tags of the record payload.
+#define LOG_ARG_INT 'i'
+#define LOG_ARG_UINT 'u'
+#define LOG_ARG_DOUBLE 'd'
+#define LOG_ARG_STRING 's'
+
+// Single producer, single consumer byte ring, one per logging thread.
+class LogRing
+{
+    std::vector<char> buffer;
+    std::atomic<uint64_t> head{0}, tail{0};
+
+  public:
+    LogRing() : buffer(LOG_RING_SIZE) {}
+
+    bool Push(const char *data, size_t size);
+    size_t Peek(char *out, size_t max);
+    void Pop(size_t size);
+    bool Empty();
+};
+
+// Callers hand over a format-string id and the raw arguments. Formatting
+// and I/O happen on a background thread, as text or, in binary mode, as a
+// stream hingy_log_decode turns back into text.
+class Logger
+{
+    struct Format
+    {
+        LogLevel level;
+        std::string format;
+    };
+
+    std::mutex formats_lock, rings_lock, drain_lock;
+    std::vector<Format> formats;
+    std::vector<std::shared_ptr<LogRing>> rings;
+    size_t formats_written = 0;
+
+    std::chrono::steady_clock::time_point start_time;
+    FILE *binary = NULL;
+    std::atomic<uint64_t> dropped{0};
+
+    std::mutex wakeup_lock;
+    std::condition_variable wakeup;
+    bool stop = false;
+    std::thread writer;
+
+    LogRing &ThreadRing();
+    // Definitions not yet in the binary log, so they go out before any
+    // record that refers to them. Called with formats_lock held.
+    void WriteFormats();
+    void Output(const char *record, size_t size);
+    void Drain();
+    void WriterLoop();
+
+    Logger();
+
+  public:
+    // Never destroyed, so it outlives everything that might log on the way
+    // out; the writer is stopped and drained at exit instead.
+    static Logger &Get();
+    void Shutdown();
+
+    int Register(LogLevel level, const char *format);
+    void Commit(const char *record, size_t size);
+
+    // Writes out everything queued so far, from the calling thread.
+    void Flush();
+    bool OpenBinary(std::string filename);
+
+    static std::string FormatRecord(const std::string &format,
+                                    const char *args, size_t size);
+    static const char *LevelPrefix(LogLevel level);
+};
+
+// === Argument encoding ===
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value &&
+                        std::is_signed<T>::value>::type
+log_encode(char *&cursor, char *end, T value)
+{
+    if (end - cursor < 9)
+        return;
+    *cursor++ = LOG_ARG_INT;
+    int64_t v = value;
+    memcpy(cursor, &v, 8);
+    cursor += 8;
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value &&
+                        !std::is_signed<T>::value>::type
+log_encode(char *&cursor, char *end, T value)
+{
+    if (end - cursor < 9)
+        return;
+    *cursor++ = LOG_ARG_UINT;
+    uint64_t v = value;
+    memcpy(cursor, &v, 8);
+    cursor += 8;
+}
+
+template <typename T>
+typename std::enable_if<std::is_floating_point<T>::value>::type
+log_encode(char *&cursor, char *end, T value)
+{
+    if (end - cursor < 9)
+        return;
+    *cursor++ = LOG_ARG_DOUBLE;
+    double v = value;
+    memcpy(cursor, &v, 8);
+    cursor += 8;
+}
+
+inline void log_encode(char *&cursor, char *end, const char *value)
+{
+    if (end - cursor < 3)
+        return;
+
+    size_t length = strlen(value);
+    uint16_t size = std::min<size_t>(length, end - cursor - 3);
+    *cursor++ = LOG_ARG_STRING;
+    memcpy(cursor, &size, 2);
+    memcpy(cursor + 2, value, size);
+
+    size_t marker = strlen(LOG_TRUNCATED);
+    if (size < length && size >= marker)
+        memcpy(cursor + 2 + size - marker, LOG_TRUNCATED, marker);
+    cursor += 2 + size;
+}
+
+inline void log_encode(char *&cursor, char *end, const std::string &value)
+{
+    log_encode(cursor, end, value.c_str());
+}
+
+inline void log_encode_all(char *&cursor, char *end) {}
+
+template <typename T, typename... Rest>
+void log_encode_all(char *&cursor, char *end, const T &value,
+                    const Rest &... rest)
+{
+    log_encode(cursor, end, value);
+    log_encode_all(cursor, end, rest...);
+}
+
+// Record layout: uint16 size, uint32 format id, uint64 ns since the logger
+// started, then the tagged arguments.
+template <typename... Args> void log_write(int id, const Args &... args)
+{
+    char record[LOG_MAX_RECORD];
+    char *cursor = record + 14;
+    uint32_t format = id;
+
+    log_encode_all(cursor, record + LOG_MAX_RECORD, args...);
+
+    uint16_t size = cursor - record;
+    memcpy(record, &size, 2);
+    memcpy(record + 2, &format, 4);
+    Logger::Get().Commit(record, size);
+}
+
+// printf-style logging that's safe on the hot path: the format string is
+// registered once per call site and only its id and the arguments are
+// copied into the calling thread's ring.
+#define HLOG(level, format, ...)                                               \
+    do                                                                         \
+    {                                                                          \
+        static const int hlog_id = Logger::Get().Register(level, format);      \
+        log_write(hlog_id, ##__VA_ARGS__);                                     \
+    } while (0)
+
+#define LOG_INFO(format, ...) HLOG(LEVEL_INFO, format, ##__VA_ARGS__)
+#define LOG_WARNING(format, ...)                                               \
+    do                                                                         \
+    {                                                                          \
+        HLOG(LEVEL_WARNING, format, ##__VA_ARGS__);                            \
+        if (crash_on_warning)                                                  \
+            log_error("Paranoid crash on warning!");                           \
+    } while (0)
@@ -1,35 +1,88 @@
 
 #include <assert.h>
-#include <chrono>
 #include <limits.h>
 #include <memory>
 
+#include "batched_integration.h"
 #include "driver.h"
+#include "flight_recorder.h"
+#include "kinematic_integration.h"
+#include "latency_stats.h"
+#include "logger.h"
 #include "main.h"
+#include "param_search.h"
+#include "realtime.h"
 #include "torcs_integration.h"
 #include "utils.h"
 
 using std::string;
-using namespace std::chrono;
 
-const std::vector<string> launch_arguments = {"host", "port",  "stage",
-                                              "gui",  "track", "params"};
+const std::vector<string> launch_arguments = {
+    "host",        "port",        "stage", "gui",         "track",
+    "params",      "integration", "cars",  "server_port", "handshake_timeout_ms",
+    "sim_time",    "sim_laps",    "mode",  "threads",     "search_generations",
+    "search_population", "search_elite", "search_seed", "search_out",
+    "snapshots",         "stats_out",    "log_binary",  "flight_out",
+    "diagnostics",       "telemetry_out", "realtime",    "realtime_cpu",
+    "track_store", "prep_dir",   "record_laps", "record_tolerance",
+    "track_dir",   "sim_track"};
 
 const std::vector<std::pair<string, string>> default_params = {
     {"track", "tmp_track.xml"},
     {"gui", "0"},
+    {"gui_fps", "30"},
+    {"snapshots", ""},
+    {"snapshot_every", "1000"},
+    {"snapshot_cycles", "0"},
+    {"snapshot_size", "1000"},
+    {"stats_interval_ms", "1000"},
+    {"stats_out", ""},
+    {"log_binary", ""},
+    {"diagnostics", "none"},
+    {"diagnostics_out", "diagnostics"},
+    {"telemetry_out", ""},
+    {"flight_records", "65536"},
+    {"flight_out", "tmp/flight.hflt"},
+    {"realtime", "0"},
+    {"realtime_cpu", "-1"},
+    {"realtime_priority", "80"},
+    {"realtime_warmup", "2000"},
     {"stage", "1"},
+    {"record_laps", "1"},
+    {"record_tolerance", "0.01"},
+    {"track_dir", "tracks"},
+    {"track_index", "tmp/track_index.htix"},
+    {"auto_track_distance", "300"},
+    {"track_store", "1"},
+    {"prep_dir", "prep"},
     {"force1", "0"},
     {"force2", "0"},
     {"hinges_iterations", "60000"},
+    {"hinges_tolerance", "1e-4"},
     {"paranoid", "0"},
+    {"integration", "torcs"},
+    {"cars", "1"},
+    {"server_port", "3001"},
+    {"handshake_retry_us", "100"},
+    {"handshake_retry_max_us", "50000"},
+    {"handshake_timeout_ms", "0"},
+    {"sim_dt", "0.02"},
+    {"sim_time", "600"},
+    {"sim_laps", "1"},
+    {"sim_track_width", "12"},
+    {"sim_track_offset", "50"},
+    {"sim_track", ""},
+    {"mode", "drive"},
+    {"threads", "0"},
+    {"search_generations", "20"},
+    {"search_population", "32"},
+    {"search_elite", "6"},
+    {"search_seed", "1"},
+    {"search_out", "configs/search.xml"},
     {"host", "127.0.0.1"}};
 
-bool crash_on_warning;
-
 int main(int argc, char **argv)
 {
-    int cycles = 0;
     stringmap launch_params;
     parse_arguments("", ':', argc - 1, &argv[1], launch_params);
 
@@ -44,55 +97,142 @@ int main(int argc, char **argv)
 
     crash_on_warning = std::stoi(launch_params["paranoid"]) != 0;
 
-    auto driver = std::unique_ptr<HingyDriver>(new HingyDriver(launch_params));
+    if (launch_params["log_binary"] != "" &&
+        !Logger::Get().OpenBinary(launch_params["log_binary"]))
+        log_error("Couldn't open " + launch_params["log_binary"] + "!");
+
+    if (launch_params["mode"] == "search")
+    {
+        ParamSearch search(launch_params);
+        search.Run();
+
+        // Same layout the offline optimizer left in configs/: the latest best
+        // plus a copy tagged with its score.
+        string out = launch_params["search_out"];
+        if (!save_params_to_xml(out, "hingybot_params", search.Best()) ||
+            !save_params_to_xml(out + "_" + std::to_string(search.BestScore()),
+                                "hingybot_params", search.Best()))
+            log_error("Couldn't write " + out + "!");
+
+        log_info("Best score " + std::to_string(search.BestScore()) +
+                 ", written to " + out);
+        return 0;
+    }
+
+    int cars = std::stoi(launch_params["cars"]);
+    std::vector<std::unique_ptr<HingyDriver>> drivers;
+    std::vector<std::unique_ptr<SimIntegration>> integrations;
 
-    std::unique_ptr<SimIntegration> integration =
-        std::unique_ptr<TorcsIntegration>(new TorcsIntegration(launch_params));
+    if (launch_params["integration"] == "batched")
+    {
+        auto transport =
+            std::make_shared<BatchedUdpTransport>(launch_params, cars);
+
+        for (int i = 0; i < cars; i++)
+            integrations.emplace_back(
+                new BatchedTorcsIntegration(transport, i));
+    }
+    else if (cars == 1 && launch_params["integration"] == "kinematic")
+    {
+        integrations.emplace_back(new KinematicIntegration(launch_params));
+    }
+    else if (cars == 1)
+    {
+        integrations.emplace_back(new TorcsIntegration(launch_params));
+    }
+    else
+    {
+        log_error("Multiple cars need integration:batched!");
+    }
+
+    std::shared_ptr<const TrackIndex> track_index;
+    if (launch_params["track"] == "auto")
+        track_index = HingyDriver::OpenTrackIndex(launch_params);
+
+    for (int i = 0; i < cars; i++)
+    {
+        auto car_params = launch_params;
+        car_params["car"] = std::to_string(i);
+        drivers.emplace_back(new HingyDriver(car_params, track_index));
+    }
+
+    std::shared_ptr<TelemetryHub> telemetry;
+    if (launch_params["telemetry_out"] != "")
+    {
+        telemetry = std::make_shared<TelemetryHub>();
+        if (!telemetry->SubscribeCsv(launch_params["telemetry_out"]))
+            log_error("Couldn't open " + launch_params["telemetry_out"] + "!");
+
+        for (int i = 0; i < cars; i++)
+            drivers[i]->SetTelemetry(telemetry, i);
+    }
+
+    std::unique_ptr<FlightRecorder> recorder;
+    if (std::stoi(launch_params["flight_records"]) > 0)
+        recorder.reset(
+            new FlightRecorder(launch_params["flight_out"],
+                               std::stoi(launch_params["flight_records"])));
+
+    // Started before going realtime, so the reporter isn't pinned with us.
+    bool realtime = std::stoi(launch_params["realtime"]) != 0;
+    latency_stats.Start(launch_params["stats_out"],
+                        std::stoi(launch_params["stats_interval_ms"]),
+                        realtime ? "realtime" : "normal");
+
+    if (realtime)
+        enter_realtime(launch_params, drivers, integrations);
 
     log_info("Waiting for the simulator hookup...");
-    auto car_state = integration->Begin(driver->GetSimulatorInitParameters());
-    CarSteers car_steers;
+    std::vector<CarState> car_states;
+    std::vector<CarSteers> car_steers(cars);
+    for (int i = 0; i < cars; i++)
+    {
+        car_states.push_back(integrations[i]->Begin(
+            drivers[i]->GetSimulatorInitParameters()));
+        if (recorder)
+            recorder->RecordState(i, car_states[i]);
+    }
     log_info("Starting the main loop!");
 
-    auto block_start_time = high_resolution_clock::now();
+    latency_stats.Reset();
 
     while (true)
     {
-        driver->Cycle(car_steers, car_state);
-        auto car_state = integration->Cycle(car_steers);
-
-        auto time = std::chrono::high_resolution_clock::now();
-        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                      time - block_start_time)
-                      .count();
-        if (ms > 1000)
+        for (int i = 0; i < cars; i++)
         {
-            log_info(std::to_string((float)cycles / ((float)ms / 1000.0f)) +
-                     " Hz");
-            cycles = 0;
-            block_start_time = high_resolution_clock::now();
+            {
+                LatencyTimer timer(STAGE_CYCLE);
+                drivers[i]->Cycle(car_steers[i], car_states[i]);
+            }
+            integrations[i]->Submit(car_steers[i]);
+            if (recorder)
+                recorder->RecordSteers(i, car_steers[i]);
         }
 
-        cycles += 1;
-    }
+        for (int i = 0; i < cars; i++)
+        {
+            car_states[i] = integrations[i]->Collect();
+            if (recorder)
+                recorder->RecordState(i, car_states[i]);
+        }
 
-    return 0;
-}
+        if (integrations[0]->Finished())
+            break;
+    }
 
-void log_error(std::string msg)
-{
-    fprintf(stderr, "[ERROR]   %s\n", msg.c_str());
-    exit(1);
-}
+    latency_stats.Stop();
+    if (recorder)
+        recorder->Stop();
+    if (telemetry)
+        telemetry->Stop();
 
-void log_warning(std::string msg)
-{
-    fprintf(stderr, "[WARNING] %s\n", msg.c_str());
-    if (crash_on_warning)
-        log_error("Paranoid crash on warning!\n");
-}
+    if (launch_params["integration"] == "kinematic")
+    {
+        auto sim = static_cast<KinematicIntegration *>(integrations[0].get());
+        log_info("Kinematic run: " + std::to_string(sim->Laps()) +
+                 " lap(s) in " + std::to_string(sim->Time()) +
+                 " s, score " + std::to_string(sim->Score()));
+    }
 
-void log_info(std::string msg)
-{
-    fprintf(stdout, "[INFO]\t  %s\n", msg.c_str());
+    return 0;
 }
@@ -5,6 +5,10 @@
 
 typedef std::map<std::string, std::string> stringmap;
 
-void log_error(std::string msg);
-void log_warning(std::string msg);
-void log_info(std::string msg);
\ No newline at end of file
+extern bool crash_on_warning;
+
+// Queued to the asynchronous logger (logger.h), log_error flushes it and
+// exits. Hot paths should use LOG_INFO/LOG_WARNING with raw arguments.
+void log_error(const std::string &msg);
+void log_warning(const std::string &msg);
+void log_info(const std::string &msg);
\ No newline at end of file
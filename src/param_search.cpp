@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+
+#include "Randomizer.h"
+#include "driver.h"
+#include "kinematic_integration.h"
+#include "param_search.h"
+
+using std::string;
+
+// Share of the previous distribution kept each generation, and the floor on
+// the spread (relative to the range) so the search never collapses entirely.
+#define SEARCH_SMOOTHING 0.3f
+#define SEARCH_MIN_SPREAD 0.005f
+
+// Enough digits that the driver parses back the very float that was sampled.
+static string format_param(float value)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9g", value);
+    return buf;
+}
+
+ParamSearch::ParamSearch(stringmap params)
+    : params(params), pool(std::stoi(params["threads"]))
+{
+    generations = std::stoi(params["search_generations"]);
+    population = std::stoi(params["search_population"]);
+    elite = std::max(1, std::min(std::stoi(params["search_elite"]),
+                                 population));
+    seed = std::stoull(params["search_seed"]);
+
+    dimensions = {{"sa", 0.0f, 60.0f},
+                  {"sb", 0.0f, 0.05f},
+                  {"sc", 0.0f, 0.3f},
+                  {"speed_base", 50.0f, 250.0f},
+                  {"speed_factor", 0.0f, 300.0f},
+                  {"master_output_factor", 0.3f, 2.0f},
+                  {"steering_factor", 0.3f, 2.0f}};
+
+    // Hinges don't depend on anything searched, so they're relaxed once and
+    // every candidate gets its own copy to build the speed profile on.
+    this->params["gui"] = "0";
+    this->params["snapshots"] = "";
+    this->params["diagnostics"] = "none";
+    this->params["stage"] = "1";
+    track = HingyDriver::PrepareTrack(this->params);
+
+    best = this->params;
+    best_score = -INFINITY;
+}
+
+float ParamSearch::Evaluate(stringmap candidate)
+{
+    HingyDriver driver(candidate, std::make_shared<HingyTrack>(*track));
+    KinematicIntegration sim(candidate, *track);
+    CarSteers steers;
+    CarState state = sim.Begin(driver.GetSimulatorInitParameters());
+
+    while (!sim.Finished())
+    {
+        driver.Cycle(steers, state);
+        state = sim.Cycle(steers);
+    }
+
+    return sim.Score();
+}
+
+void ParamSearch::Run()
+{
+    int dims = dimensions.size();
+    std::vector<float> mean(dims), spread(dims);
+
+    for (int d = 0; d < dims; d++)
+    {
+        mean[d] = std::stof(params[dimensions[d].name]);
+        spread[d] = (dimensions[d].max - dimensions[d].min) / 8.0f;
+    }
+
+    log_info("Searching " + std::to_string(generations) + "x" +
+             std::to_string(population) + " candidates on " +
+             std::to_string(pool.Threads()) + " thread(s)");
+
+    for (int g = 0; g < generations; g++)
+    {
+        std::vector<std::vector<float>> samples(population,
+                                                std::vector<float>(dims));
+        std::vector<float> scores(population);
+        std::vector<std::function<void()>> tasks;
+
+        for (int i = 0; i < population; i++)
+        {
+            tasks.push_back([&, g, i]() {
+                Randomizer<float, Philox4x32> random(
+                    Philox4x32(seed, ((uint64_t)g << 32) | (uint32_t)i));
+                stringmap candidate = params;
+
+                // Candidate 0 is the mean itself, so a generation can't
+                // score worse than the distribution it came from.
+                for (int d = 0; d < dims; d++)
+                {
+                    float value = mean[d];
+                    if (i != 0)
+                        value = random.RandomNormal(mean[d], spread[d]);
+
+                    value = std::max(dimensions[d].min,
+                                     std::min(value, dimensions[d].max));
+                    samples[i][d] = value;
+                    candidate[dimensions[d].name] = format_param(value);
+                }
+
+                scores[i] = Evaluate(candidate);
+            });
+        }
+
+        pool.Run(std::move(tasks));
+
+        std::vector<int> order(population);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+                         [&](int a, int b) { return scores[a] > scores[b]; });
+
+        if (scores[order[0]] > best_score)
+        {
+            best_score = scores[order[0]];
+            for (int d = 0; d < dims; d++)
+                best[dimensions[d].name] =
+                    format_param(samples[order[0]][d]);
+        }
+
+        for (int d = 0; d < dims; d++)
+        {
+            float elite_mean = 0.0f, elite_var = 0.0f;
+
+            for (int e = 0; e < elite; e++)
+                elite_mean += samples[order[e]][d] / elite;
+            for (int e = 0; e < elite; e++)
+                elite_var += std::pow(samples[order[e]][d] - elite_mean, 2.0f) /
+                             elite;
+
+            mean[d] = SEARCH_SMOOTHING * mean[d] +
+                      (1.0f - SEARCH_SMOOTHING) * elite_mean;
+            spread[d] = std::max(
+                SEARCH_SMOOTHING * spread[d] +
+                    (1.0f - SEARCH_SMOOTHING) * std::sqrt(elite_var),
+                SEARCH_MIN_SPREAD * (dimensions[d].max - dimensions[d].min));
+        }
+
+        log_info("Generation " + std::to_string(g) + ": best " +
+                 std::to_string(scores[order[0]]) + ", elite worst " +
+                 std::to_string(scores[order[elite - 1]]) + ", overall " +
+                 std::to_string(best_score));
+    }
+}
+
+stringmap ParamSearch::Best()
+{
+    stringmap out;
+
+    for (auto &dimension : dimensions)
+        out[dimension.name] = best[dimension.name];
+
+    return out;
+}
+
+float ParamSearch::BestScore() { return best_score; }
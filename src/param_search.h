@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hingy_track.h"
+#include "main.h"
+#include "thread_pool.h"
+
+// Cross-entropy search over the driver parameters, scored on the kinematic
+// simulator. Candidate i of generation g always draws from Philox stream
+// (g, i) of the seed, so a run reproduces exactly on any number of threads.
+class ParamSearch
+{
+    struct Dimension
+    {
+        std::string name;
+        float min, max;
+    };
+
+    stringmap params;
+    std::shared_ptr<HingyTrack> track;
+    std::vector<Dimension> dimensions;
+    WorkStealingPool pool;
+
+    int generations, population, elite;
+    uint64_t seed;
+
+    stringmap best;
+    float best_score;
+
+    float Evaluate(stringmap candidate);
+
+  public:
+    ParamSearch(stringmap params);
+
+    void Run();
+    stringmap Best();
+    float BestScore();
+};
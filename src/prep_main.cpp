@@ -0,0 +1,182 @@
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <sstream>
+
+#include <sys/stat.h>
+
+#include "hinge_batch.h"
+#include "hingy_track.h"
+#include "logger.h"
+#include "main.h"
+#include "thread_pool.h"
+#include "track_codec.h"
+#include "track_store.h"
+#include "utils.h"
+
+using std::string;
+
+// Builds the hinge ring and speed profile of every track in a directory for
+// every parameter file given, in parallel, and saves each combination as an
+// artifact named after its track store key. The parameter files of a track
+// are relaxed together, see HingeBatch. hingybot looks artifacts up in
+// its prep_dir by that key, so an edited track or parameter file just misses.
+// The batch agrees with the bot's own relaxation to about 1e-4 but not bit
+// for bit, so the same key can hold slightly different hinges depending on
+// which of the two built it. With purge:1, removes every track published to shared memory instead.
+
+const std::vector<std::pair<string, string>> default_params = {
+    {"tracks", "tracks"},
+    {"params", "configs/best.xml"},
+    {"out", "prep"},
+    {"threads", "0"},
+    {"rebuild", "0"},
+    {"force1", "0"},
+    {"force2", "0"},
+    {"hinges_iterations", "60000"},
+    {"hinges_tolerance", "1e-4"},
+    {"purge", "0"},
+    {"paranoid", "0"}};
+
+int main(int argc, char **argv)
+{
+    stringmap launch_params;
+    parse_arguments("", ':', argc - 1, &argv[1], launch_params);
+
+    for (auto &param : default_params)
+        if (launch_params.find(param.first) == launch_params.end())
+            launch_params[param.first] = param.second;
+
+    crash_on_warning = std::stoi(launch_params["paranoid"]) != 0;
+
+    if (std::stoi(launch_params["purge"]))
+    {
+        log_info("Removed " + std::to_string(TrackStore::Purge()) +
+                 " shared track(s)");
+        return 0;
+    }
+
+    string out = launch_params["out"];
+    bool rebuild = std::stoi(launch_params["rebuild"]) != 0;
+
+    auto tracks = list_files(launch_params["tracks"], ".xml");
+    for (auto &track : list_files(launch_params["tracks"], TRACK_CODEC_SUFFIX))
+        tracks.push_back(track);
+    if (tracks.size() == 0)
+        log_error("No tracks in " + launch_params["tracks"] + "!");
+
+    mkdir(out.c_str(), 0755);
+
+    // Combinations to build, grouped by track and iteration count: those
+    // only differ in forces, so their hinges are relaxed as one batch.
+    struct Job
+    {
+        stringmap params;
+        string file, artifact;
+    };
+    std::map<std::pair<string, int>, std::vector<Job>> groups;
+    std::atomic<int> built{0}, skipped{0}, failed{0};
+
+    std::stringstream files(launch_params["params"]);
+    string file;
+    while (std::getline(files, file, ','))
+    {
+        stringmap params;
+        if (!load_params_from_xml(file, "hingybot_params", params))
+            log_error("Parameters couldn't be read from " + file + "!");
+
+        for (auto &param : launch_params)
+            if (params.find(param.first) == params.end())
+                params[param.first] = param.second;
+
+        for (auto &track_file : tracks)
+        {
+            params["track"] = track_file;
+
+            string key = TrackStore::Key(params);
+            if (key == "")
+            {
+                failed++;
+                log_warning("Couldn't read " + track_file + "!");
+                continue;
+            }
+
+            string artifact = out + "/" + TrackStore::ArtifactName(key);
+            if (!rebuild && TrackStore::Load(artifact))
+            {
+                skipped++;
+                continue;
+            }
+
+            int iterations = std::stoi(params["hinges_iterations"]);
+            groups[{track_file, iterations}].push_back(
+                {params, file, artifact});
+        }
+    }
+
+    std::vector<std::function<void()>> tasks;
+    for (auto &group : groups)
+    {
+        string track_file = group.first.first;
+        int iterations = group.first.second;
+        auto jobs = group.second;
+
+        tasks.push_back([=, &built, &failed]() {
+            auto start = std::chrono::steady_clock::now();
+
+            // What HingyDriver::PrepareTrack does on a cache miss, for every
+            // force pair at once, and the speed profile after it.
+            HingyTrack track(track_file);
+            track.ConstructBounds();
+            track.ConstructHinges(HINGE_SKIP);
+
+            std::vector<std::pair<float, float>> forces;
+            for (auto &job : jobs)
+                forces.push_back({std::stof(job.params.at("force1")),
+                                  std::stof(job.params.at("force2"))});
+
+            HingeBatch batch(track, forces);
+            batch.Simulate(iterations + 1);
+
+            for (int lane = 0; lane < jobs.size(); lane++)
+            {
+                auto &job = jobs[lane];
+                HingyTrack prepared(track);
+
+                batch.Store(lane, prepared);
+                prepared.ConstructSpeeds(std::stof(job.params.at("sa")),
+                                         std::stof(job.params.at("sb")),
+                                         std::stof(job.params.at("sc")));
+
+                if (!prepared.SaveArtifact(job.artifact))
+                {
+                    failed++;
+                    log_warning("Couldn't write " + job.artifact + "!");
+                    continue;
+                }
+
+                built++;
+                log_info(track_file + " with " + job.file + " -> " +
+                         job.artifact);
+            }
+
+            log_info(track_file + ": " + std::to_string(jobs.size()) +
+                     " force pair(s) relaxed in " +
+                     std::to_string(std::chrono::duration<float>(
+                                        std::chrono::steady_clock::now() -
+                                        start)
+                                        .count()) +
+                     " s");
+        });
+    }
+
+    WorkStealingPool pool(std::stoi(launch_params["threads"]));
+    log_info("Preparing " + std::to_string(tasks.size()) +
+             " track(s) on " + std::to_string(pool.Threads()) +
+             " thread(s)");
+    pool.Run(std::move(tasks));
+
+    log_info(std::to_string(built) + " built, " + std::to_string(skipped) +
+             " up to date, " + std::to_string(failed) + " failed");
+    return failed > 0;
+}
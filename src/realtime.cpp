@@ -0,0 +1,140 @@
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "realtime.h"
+#include "standin_server.h"
+
+using std::string;
+using std::to_string;
+
+// The control loop's affinity from before it was pinned.
+static cpu_set_t original_cpus;
+static std::atomic<bool> entered(false);
+
+static void report(bool obtained, const string &what, int error = 0)
+{
+    log_info("Realtime: " + what +
+             (obtained ? "" : " failed (" + string(strerror(error)) + ")"));
+}
+
+// The CPUs this process may run on, highest first.
+static std::vector<int> allowed_cpus()
+{
+    cpu_set_t set;
+    std::vector<int> cpus;
+
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return {0};
+
+    for (int cpu = CPU_SETSIZE - 1; cpu >= 0; cpu--)
+        if (CPU_ISSET(cpu, &set))
+            cpus.push_back(cpu);
+
+    return cpus;
+}
+
+// Not inlined, so the frame really is carved out of the stack below ours.
+static void __attribute__((noinline)) prefault_stack()
+{
+    volatile char stack[REALTIME_STACK_PREFAULT];
+
+    for (int offset = 0; offset < REALTIME_STACK_PREFAULT; offset += 4096)
+        stack[offset] = 0;
+}
+
+void enter_realtime(stringmap params,
+                    std::vector<std::unique_ptr<HingyDriver>> &drivers,
+                    std::vector<std::unique_ptr<SimIntegration>> &integrations)
+{
+    int cpu = std::stoi(params["realtime_cpu"]);
+    int priority = std::stoi(params["realtime_priority"]);
+    int cycles = std::stoi(params["realtime_warmup"]);
+
+    auto cpus = allowed_cpus();
+    if (cpu < 0)
+        cpu = cpus[0];
+
+    if (pthread_getaffinity_np(pthread_self(), sizeof(original_cpus),
+                               &original_cpus) == 0)
+        entered = true;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    report(error == 0, "pinned to CPU " + to_string(cpu), error);
+
+    // The receive loops poll, alone on a CPU they would starve everything
+    // else, the simulator included, until the kernel throttles them.
+    if (cpus.size() > 1)
+    {
+        sched_param sched;
+        sched.sched_priority = priority;
+        error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sched);
+        report(error == 0, "SCHED_FIFO at priority " + to_string(priority),
+               error);
+    }
+    else
+    {
+        log_info("Realtime: SCHED_FIFO skipped, only one CPU available");
+    }
+
+    // Freed memory stays with the process, otherwise the heap would shrink
+    // and then regrow through fresh faults.
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    error = mlockall(MCL_CURRENT | MCL_FUTURE) == 0 ? 0 : errno;
+    bool locked = error == 0;
+    report(locked, "memory locked", error);
+
+    prefault_stack();
+    size_t bytes = REALTIME_STACK_PREFAULT;
+    for (auto &driver : drivers)
+        bytes += driver->Prefault();
+    for (auto &integration : integrations)
+        bytes += integration->Prefault();
+    report(true, to_string(bytes / 1024) + " KiB prefaulted" +
+                     (locked ? "" : ", not locked"));
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto &driver : drivers)
+        driver->WarmUp(cycles);
+
+    // The rest of a cycle is parsing the state and encoding the steers.
+    CarState state;
+    CarSteers steers;
+    state.sensors.fill(200.0f);
+    string in = StandinServer::EncodeCarState(state), out;
+
+    for (int i = 0; i < cycles; i++)
+    {
+        state = TorcsIntegration::ParseCarState(in);
+        out = TorcsIntegration::EncodeCarSteers(steers);
+    }
+
+    report(true, to_string(cycles) + " warm-up cycles in " +
+                     to_string(std::chrono::duration<float, std::milli>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count()) +
+                     " ms");
+}
+
+void leave_realtime()
+{
+    if (!entered)
+        return;
+
+    sched_param sched;
+    sched.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &sched);
+    pthread_setaffinity_np(pthread_self(), sizeof(original_cpus),
+                           &original_cpus);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "driver.h"
+#include "main.h"
+#include "torcs_integration.h"
+
+#define REALTIME_STACK_PREFAULT (512 * 1024)
+
+// Prepares the calling thread to run the control loop: pins it to
+// realtime_cpu (-1 for the last CPU it may use), asks for SCHED_FIFO at
+// realtime_priority, locks all memory, faults in the stack, the tracks and
+// the receive buffers, and runs realtime_warmup cycles of every driver on
+// scratch copies. Each step is best effort; what was actually obtained is
+// logged. Call before the handshake and before starting any thread that
+// should not inherit the pinning.
+void enter_realtime(stringmap params,
+                    std::vector<std::unique_ptr<HingyDriver>> &drivers,
+                    std::vector<std::unique_ptr<SimIntegration>> &integrations);
+
+// Puts the calling thread back to SCHED_OTHER on the CPUs the process had
+// before enter_realtime, nothing when it wasn't called. Background work
+// started from the control loop calls it first, otherwise it and the threads
+// it starts share the control loop's CPU at its priority.
+void leave_realtime();
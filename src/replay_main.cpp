@@ -0,0 +1,232 @@
+#include <chrono>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "driver.h"
+#include "flight_recorder.h"
+#include "logger.h"
+#include "main.h"
+#include "utils.h"
+
+using std::string;
+using namespace std::chrono;
+
+// Feeds the states of a flight recording into a HingyDriver as fast as it
+// goes. Checks the steers it produces are bit-identical to the ones in the
+// recording (or in another reference recording) and reports ns per cycle,
+// with hardware counters where the kernel allows them. The track has to be
+// built the way it was for the recording, from a hingy_prep artifact or
+// relaxed by the bot, as the two aren't bit-identical.
+
+const std::vector<std::pair<string, string>> default_params = {
+    {"flight", "tmp/flight.hflt"},
+    {"reference", ""},
+    {"car", "0"},
+    {"repeat", "10"},
+    {"track", "tmp_track.xml"},
+    {"gui", "0"},
+    {"stage", "1"},
+    {"track_store", "1"},
+    {"prep_dir", "prep"},
+    {"force1", "0"},
+    {"force2", "0"},
+    {"hinges_iterations", "60000"},
+    {"hinges_tolerance", "1e-4"},
+    {"paranoid", "0"},
+    {"snapshots", ""},
+    {"snapshot_every", "1000"},
+    {"snapshot_cycles", "0"},
+    {"snapshot_size", "1000"},
+    {"diagnostics", "none"},
+    {"diagnostics_out", "diagnostics"}};
+
+struct PerfCounter
+{
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+    int fd = -1;
+};
+
+// Opens the counters as one group led by the first, so they cover exactly
+// the same instructions. Whichever the kernel refuses are left out.
+std::vector<PerfCounter> open_counters()
+{
+    std::vector<PerfCounter> counters = {
+        {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {"l1d_misses", PERF_TYPE_HW_CACHE,
+         PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}};
+    std::vector<PerfCounter> opened;
+    int leader = -1;
+
+    for (auto &counter : counters)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counter.type;
+        attr.config = counter.config;
+        attr.disabled = leader == -1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        counter.fd = syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+        if (counter.fd < 0)
+            continue;
+
+        if (leader == -1)
+            leader = counter.fd;
+        opened.push_back(counter);
+    }
+
+    return opened;
+}
+
+int main(int argc, char **argv)
+{
+    stringmap params;
+    parse_arguments("", ':', argc - 1, &argv[1], params);
+
+    if (params.find("params") == params.end() ||
+        !load_params_from_xml(params["params"], "hingybot_params", params))
+        log_error("Driver parameters couldn't be read from the xml!");
+
+    for (auto &param : default_params)
+        if (params.find(param.first) == params.end())
+            params[param.first] = param.second;
+
+    // Replays must not depend on anything but the recording.
+    params["gui"] = "0";
+    params["stage"] = "1";
+    crash_on_warning = std::stoi(params["paranoid"]) != 0;
+
+    std::vector<FlightRecord> records, reference_records;
+    string reference =
+        params["reference"] != "" ? params["reference"] : params["flight"];
+    int car = std::stoi(params["car"]);
+    int repeat = std::max(1, std::stoi(params["repeat"]));
+
+    if (!FlightRecorder::Load(params["flight"], records))
+        log_error("Couldn't read a flight recording from " + params["flight"]);
+    if (!FlightRecorder::Load(reference, reference_records))
+        log_error("Couldn't read a flight recording from " + reference);
+
+    std::vector<CarState> states;
+    std::vector<CarSteers> expected;
+
+    for (auto &record : records)
+        if (record.car == car && record.kind == FLIGHT_STATE)
+            states.push_back(record.State());
+    for (auto &record : reference_records)
+        if (record.car == car && record.kind == FLIGHT_STEERS)
+            expected.push_back(record.Steers());
+
+    // A recording cut by the ring starts mid-race; the driver's controllers
+    // won't be in the state they were, so early mismatches are expected.
+    if (states.size() == 0)
+        log_error("No states of car " + std::to_string(car) + " recorded!");
+    if (records[0].kind != FLIGHT_STATE || states[0].current_lap_time > 1.0f)
+        log_warning("The recording doesn't start with the session, expect "
+                    "mismatches until the controllers settle.");
+
+    auto track = HingyDriver::PrepareTrack(params);
+    auto counters = open_counters();
+    std::vector<uint64_t> counts(counters.size(), 0);
+    double best_ns = 1e300, total_ns = 0.0;
+    int cycles = std::min(states.size(), expected.size());
+    int mismatches = 0, first_mismatch = -1;
+    std::vector<CarSteers> produced(cycles);
+
+    log_info("Replaying " + std::to_string(cycles) + " cycles x" +
+             std::to_string(repeat) + ", " + std::to_string(counters.size()) +
+             " hardware counter(s) available");
+
+    for (int r = 0; r < repeat; r++)
+    {
+        HingyDriver driver(params, std::make_shared<HingyTrack>(*track));
+        CarSteers steers;
+
+        if (counters.size() > 0)
+        {
+            ioctl(counters[0].fd, PERF_EVENT_IOC_RESET,
+                  PERF_IOC_FLAG_GROUP);
+            ioctl(counters[0].fd, PERF_EVENT_IOC_ENABLE,
+                  PERF_IOC_FLAG_GROUP);
+        }
+        auto start = steady_clock::now();
+
+        // The steers are carried over between cycles like main does, the
+        // driver reads some of its previous output.
+        for (int i = 0; i < cycles; i++)
+        {
+            driver.Cycle(steers, states[i]);
+            produced[i] = steers;
+        }
+
+        double ns = duration<double, std::nano>(steady_clock::now() - start)
+                        .count();
+        if (counters.size() > 0)
+            ioctl(counters[0].fd, PERF_EVENT_IOC_DISABLE,
+                  PERF_IOC_FLAG_GROUP);
+
+        for (int c = 0; c < counters.size(); c++)
+        {
+            uint64_t value = 0;
+            if (read(counters[c].fd, &value, sizeof(value)) == sizeof(value))
+                counts[c] += value;
+        }
+
+        best_ns = std::min(best_ns, ns);
+        total_ns += ns;
+
+        int run_mismatches = 0;
+        for (int i = 0; i < cycles; i++)
+        {
+            if (memcmp(&produced[i], &expected[i], sizeof(CarSteers)) == 0)
+                continue;
+
+            if (first_mismatch == -1 || i < first_mismatch)
+                first_mismatch = i;
+            run_mismatches++;
+        }
+        mismatches = std::max(mismatches, run_mismatches);
+    }
+
+    // Whatever was logged goes out before the results.
+    Logger::Get().Flush();
+    printf("cycles=%d repeat=%d ns_per_cycle_mean=%.1f ns_per_cycle_best=%.1f\n",
+           cycles, repeat, total_ns / repeat / cycles, best_ns / cycles);
+
+    for (int c = 0; c < counters.size(); c++)
+    {
+        printf("%s_per_cycle=%.2f ", counters[c].name,
+               (double)counts[c] / repeat / cycles);
+        close(counters[c].fd);
+    }
+    if (counters.size() > 0)
+        printf("\n");
+
+    if (mismatches == 0)
+    {
+        printf("steers=identical\n");
+        return 0;
+    }
+
+    auto &got = produced[first_mismatch], &want = expected[first_mismatch];
+    printf("steers=different mismatched_cycles=%d first=%d\n", mismatches,
+           first_mismatch);
+    printf("first: steering %.9g/%.9g gas %.9g/%.9g brake %.9g/%.9g gear "
+           "%d/%d clutch %.9g/%.9g (replayed/reference)\n",
+           got.steering_wheel, want.steering_wheel, got.gas, want.gas,
+           got.hand_brake, want.hand_brake, got.gear, want.gear, got.clutch,
+           want.clutch);
+
+    return 1;
+}
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cfloat>
+
+#include "segment_index.h"
+
+using Segment = std::pair<Vector2D, Vector2D>;
+
+static float box_distance(float lx, float ly, float hx, float hy,
+                          Vector2D point)
+{
+    float dx = std::max(std::max(lx - point.x, point.x - hx), 0.0f);
+    float dy = std::max(std::max(ly - point.y, point.y - hy), 0.0f);
+    return dx * dx + dy * dy;
+}
+
+static float point_distance(Vector2D a, Vector2D point)
+{
+    float dx = a.x - point.x, dy = a.y - point.y;
+    return dx * dx + dy * dy;
+}
+
+static float segment_distance(const Segment &segment, Vector2D point)
+{
+    float ex = segment.second.x - segment.first.x;
+    float ey = segment.second.y - segment.first.y;
+    float length = ex * ex + ey * ey;
+    float t = length > 0.0f ? ((point.x - segment.first.x) * ex +
+                               (point.y - segment.first.y) * ey) /
+                                  length
+                            : 0.0f;
+    t = std::min(std::max(t, 0.0f), 1.0f);
+
+    return point_distance(
+        Vector2D{segment.first.x + t * ex, segment.first.y + t * ey}, point);
+}
+
+// Which side of a-b the point is on, 0 when it's on the line.
+static float side(Vector2D a, Vector2D b, Vector2D point)
+{
+    return (b.x - a.x) * (point.y - a.y) - (b.y - a.y) * (point.x - a.x);
+}
+
+static bool crosses(const Segment &segment, Vector2D a, Vector2D b)
+{
+    float s1 = side(a, b, segment.first), s2 = side(a, b, segment.second);
+    float s3 = side(segment.first, segment.second, a);
+    float s4 = side(segment.first, segment.second, b);
+
+    if (((s1 > 0.0f && s2 < 0.0f) || (s1 < 0.0f && s2 > 0.0f)) &&
+        ((s3 > 0.0f && s4 < 0.0f) || (s3 < 0.0f && s4 > 0.0f)))
+        return true;
+
+    // Touching, or collinear and overlapping.
+    auto within = [](Vector2D p, Vector2D q, Vector2D point) {
+        return std::min(p.x, q.x) <= point.x && point.x <= std::max(p.x, q.x) &&
+               std::min(p.y, q.y) <= point.y && point.y <= std::max(p.y, q.y);
+    };
+
+    return (s1 == 0.0f && within(a, b, segment.first)) ||
+           (s2 == 0.0f && within(a, b, segment.second)) ||
+           (s3 == 0.0f && within(segment.first, segment.second, a)) ||
+           (s4 == 0.0f && within(segment.first, segment.second, b));
+}
+
+void SegmentIndex::Refit(const std::vector<Segment> &segments)
+{
+    if (segments.size() != this->segments.size() || nodes.empty())
+    {
+        size_t needed =
+            (segments.size() + SEGMENT_INDEX_LEAF - 1) / SEGMENT_INDEX_LEAF;
+        for (leaves = 1; leaves < needed;)
+            leaves *= 2;
+        nodes.resize(2 * leaves);
+    }
+
+    this->segments = segments;
+
+    for (size_t leaf = 0; leaf < leaves; leaf++)
+    {
+        Box box{FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX};
+        size_t begin = leaf * SEGMENT_INDEX_LEAF;
+        size_t end = std::min(begin + SEGMENT_INDEX_LEAF, segments.size());
+
+        for (size_t i = begin; i < end; i++)
+            for (auto &point : {segments[i].first, segments[i].second})
+            {
+                box.lx = std::min(box.lx, point.x);
+                box.ly = std::min(box.ly, point.y);
+                box.hx = std::max(box.hx, point.x);
+                box.hy = std::max(box.hy, point.y);
+            }
+
+        nodes[leaves + leaf] = box;
+    }
+
+    for (size_t node = leaves - 1; node > 0; node--)
+    {
+        const Box &left = nodes[2 * node], &right = nodes[2 * node + 1];
+        nodes[node] = Box{std::min(left.lx, right.lx),
+                          std::min(left.ly, right.ly),
+                          std::max(left.hx, right.hx),
+                          std::max(left.hy, right.hy)};
+    }
+}
+
+size_t SegmentIndex::Size() const { return segments.size(); }
+
+// Depth first, nearer child first, skipping boxes no nearer than the best so
+// far.
+template <typename Distance>
+int SegmentIndex::Nearest(Vector2D point, Distance distance) const
+{
+    int found = -1;
+    float best = FLT_MAX;
+    size_t stack[64];
+    int top = 0;
+
+    if (segments.empty())
+        return -1;
+
+    auto box = [&](size_t node) {
+        const auto &b = nodes[node];
+        return box_distance(b.lx, b.ly, b.hx, b.hy, point);
+    };
+
+    stack[top++] = 1;
+    while (top > 0)
+    {
+        size_t node = stack[--top];
+        if (box(node) >= best)
+            continue;
+
+        if (node >= leaves)
+        {
+            size_t begin = (node - leaves) * SEGMENT_INDEX_LEAF;
+            size_t end = std::min(begin + SEGMENT_INDEX_LEAF, segments.size());
+
+            for (size_t i = begin; i < end; i++)
+            {
+                float d = distance(segments[i], point);
+                if (d < best)
+                {
+                    best = d;
+                    found = i;
+                }
+            }
+            continue;
+        }
+
+        size_t near = 2 * node, far = 2 * node + 1;
+        if (box(far) < box(near))
+            std::swap(near, far);
+
+        stack[top++] = far;
+        stack[top++] = near;
+    }
+
+    return found;
+}
+
+int SegmentIndex::NearestStart(Vector2D point) const
+{
+    return Nearest(point, [](const Segment &segment, Vector2D point) {
+        return point_distance(segment.first, point);
+    });
+}
+
+int SegmentIndex::NearestSegment(Vector2D point) const
+{
+    return Nearest(point, segment_distance);
+}
+
+void SegmentIndex::Crossing(Vector2D a, Vector2D b, std::vector<int> &out) const
+{
+    if (segments.empty())
+        return;
+
+    Box query{std::min(a.x, b.x), std::min(a.y, b.y), std::max(a.x, b.x),
+              std::max(a.y, b.y)};
+    size_t stack[64];
+    int top = 0;
+
+    stack[top++] = 1;
+    while (top > 0)
+    {
+        size_t node = stack[--top];
+        const Box &box = nodes[node];
+
+        if (box.lx > query.hx || box.hx < query.lx || box.ly > query.hy ||
+            box.hy < query.ly)
+            continue;
+
+        // Boxes the line passes by entirely on one side.
+        float s1 = side(a, b, Vector2D{box.lx, box.ly});
+        float s2 = side(a, b, Vector2D{box.hx, box.ly});
+        float s3 = side(a, b, Vector2D{box.lx, box.hy});
+        float s4 = side(a, b, Vector2D{box.hx, box.hy});
+        if ((s1 > 0.0f && s2 > 0.0f && s3 > 0.0f && s4 > 0.0f) ||
+            (s1 < 0.0f && s2 < 0.0f && s3 < 0.0f && s4 < 0.0f))
+            continue;
+
+        if (node >= leaves)
+        {
+            size_t begin = (node - leaves) * SEGMENT_INDEX_LEAF;
+            size_t end = std::min(begin + SEGMENT_INDEX_LEAF, segments.size());
+
+            for (size_t i = begin; i < end; i++)
+                if (crosses(segments[i], a, b))
+                    out.push_back(i);
+            continue;
+        }
+
+        // Right first, so the left comes off the stack first and the
+        // segments come out in order.
+        stack[top++] = 2 * node + 1;
+        stack[top++] = 2 * node;
+    }
+}
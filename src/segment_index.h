@@ -0,0 +1,41 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "hingy_math.h"
+
+// Segments per leaf box.
+#define SEGMENT_INDEX_LEAF 8
+
+// Bounding boxes over runs of consecutive segments of a polyline, as a
+// complete binary tree in one array, node k's children at 2k and 2k + 1.
+// Consecutive segments of a track lie close together, so grouping them in
+// order keeps the boxes tight without sorting, and a refit after the
+// segments move is one pass over them that keeps the layout.
+class SegmentIndex
+{
+    struct Box
+    {
+        float lx, ly, hx, hy;
+    };
+
+    std::vector<std::pair<Vector2D, Vector2D>> segments;
+    std::vector<Box> nodes;
+    size_t leaves = 0;
+
+    template <typename Distance>
+    int Nearest(Vector2D point, Distance distance) const;
+
+  public:
+    // Takes the segments over, rebuilding only when their count changed.
+    void Refit(const std::vector<std::pair<Vector2D, Vector2D>> &segments);
+
+    size_t Size() const;
+    // The segment whose start, or any point of which, is nearest, -1 when
+    // there are none.
+    int NearestStart(Vector2D point) const;
+    int NearestSegment(Vector2D point) const;
+    // Appends the segments the one from a to b touches, in order.
+    void Crossing(Vector2D a, Vector2D b, std::vector<int> &out) const;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+// A vector that can instead be a read-only view into memory kept alive by
+// someone else, e.g. a shared mapping. Reads look the same either way,
+// writes go through Mutable(), which first turns a view into a copy of its
+// own.
+template <typename T> class SharedArray
+{
+    std::vector<T> items;
+    std::shared_ptr<const void> owner;
+    const T *view = nullptr;
+    size_t view_size = 0;
+
+  public:
+    bool Shared() const { return owner != nullptr; }
+
+    void Attach(std::shared_ptr<const void> owner, const T *data, size_t size)
+    {
+        this->owner = owner;
+        view = data;
+        view_size = size;
+        std::vector<T>().swap(items);
+    }
+
+    std::vector<T> &Mutable()
+    {
+        if (owner)
+        {
+            items.assign(view, view + view_size);
+            owner.reset();
+            view = nullptr;
+            view_size = 0;
+        }
+
+        return items;
+    }
+
+    const T *data() const { return owner ? view : items.data(); }
+    size_t size() const { return owner ? view_size : items.size(); }
+    const T &operator[](size_t i) const { return data()[i]; }
+    const T *begin() const { return data(); }
+    const T *end() const { return data() + size(); }
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#define CACHE_LINE 64
+
+// Bounded single-producer, single-consumer queue of fixed-size records.
+// Push and Pop never wait; each side keeps a cached copy of the other's
+// index and only rereads it when the cached one says full or empty. The
+// indices live on their own cache lines so the two threads don't share one.
+template <typename T> class SpscRing
+{
+    std::vector<T> slots;
+    size_t mask;
+
+    char pad0[CACHE_LINE];
+    std::atomic<size_t> head{0};
+    size_t cached_tail = 0;
+    char pad1[CACHE_LINE];
+    std::atomic<size_t> tail{0};
+    size_t cached_head = 0;
+    char pad2[CACHE_LINE];
+
+    static size_t RoundUp(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        return size;
+    }
+
+  public:
+    SpscRing(size_t capacity)
+        : slots(RoundUp(capacity)), mask(RoundUp(capacity) - 1)
+    {
+    }
+
+    // Producer side, false when full.
+    bool Push(const T &value)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+
+        if (h - cached_tail == slots.size())
+        {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h - cached_tail == slots.size())
+                return false;
+        }
+
+        slots[h & mask] = value;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, false when empty.
+    bool Pop(T &value)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+
+        if (t == cached_head)
+        {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t == cached_head)
+                return false;
+        }
+
+        value = slots[t & mask];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+};
@@ -0,0 +1,139 @@
+#include <chrono>
+#include <thread>
+
+#include "logger.h"
+#include "main.h"
+#include "standin_server.h"
+#include "utils.h"
+
+using std::string;
+using namespace std::chrono;
+
+// Stand-in for TORCS' scr_server. Identifies the bots, feeds them states
+// (replayed from a flight recording or capture, or synthesised) at a fixed
+// rate or as fast as they answer, then reports round trip percentiles and
+// sends ***shutdown***.
+
+const std::vector<std::pair<string, string>> default_params = {
+    {"port", "3001"},       {"cars", "1"},         {"ticks", "10000"},
+    {"hz", "0"},            {"timeout_us", "10000"}, {"speed", "100"},
+    {"lap_length", "3000"}, {"replay", ""},          {"replay_car", "0"}};
+
+std::vector<string> SynthesiseStates(int ticks, float hz, float speed,
+                                     float lap_length)
+{
+    std::vector<string> messages;
+    CarState state;
+    float dt = 1.0f / (hz > 0.0f ? hz : 50.0f);
+
+    state.sensors.fill(200.0f);
+    state.gear = 3.0f;
+    state.rpm = 6000.0f;
+    state.speed_x = speed;
+
+    for (int t = 0; t < ticks; t++)
+    {
+        messages.push_back(StandinServer::EncodeCarState(state));
+
+        state.current_lap_time += dt;
+        state.absolute_odometer += speed / 3.6f * dt;
+        if (state.absolute_odometer > lap_length)
+        {
+            state.absolute_odometer -= lap_length;
+            state.current_lap_time = 0.0f;
+        }
+        state.wheels_speeds.fill(speed / 3.6f / 0.3f);
+    }
+
+    return messages;
+}
+
+int main(int argc, char **argv)
+{
+    stringmap params;
+    parse_arguments("", ':', argc - 1, &argv[1], params);
+
+    for (auto &param : default_params)
+        if (params.find(param.first) == params.end())
+            params[param.first] = param.second;
+
+    int cars = std::stoi(params["cars"]);
+    int ticks = std::stoi(params["ticks"]);
+    int timeout_us = std::stoi(params["timeout_us"]);
+    float hz = std::stof(params["hz"]);
+
+    std::vector<string> stream;
+    if (params["replay"] != "")
+    {
+        stream = StandinServer::LoadCapture(params["replay"],
+                                            std::stoi(params["replay_car"]));
+        if (stream.size() == 0)
+            log_error("Nothing to replay in " + params["replay"] + "!");
+        log_info("Replaying " + std::to_string(stream.size()) +
+                 " states from " + params["replay"]);
+    }
+    else
+    {
+        stream = SynthesiseStates(ticks, hz, std::stof(params["speed"]),
+                                  std::stof(params["lap_length"]));
+    }
+
+    StandinServer server(std::stoi(params["port"]), cars);
+    std::vector<string> messages(cars);
+    int late_ticks = 0;
+
+    log_info("Waiting for " + std::to_string(cars) + " bot(s)...");
+    server.AwaitClients();
+    log_info("Bots identified, serving " + std::to_string(ticks) + " ticks");
+
+    // Tick 0 gives the bots time to finish their handshake and isn't counted.
+    messages.assign(cars, stream[0]);
+    server.Tick(messages, 5000000);
+    server.ResetStats();
+
+    auto period = hz > 0.0f ? nanoseconds((long)(1e9 / hz)) : nanoseconds(0);
+    auto start_time = steady_clock::now();
+    auto next_tick = start_time;
+
+    for (int t = 1; t < ticks; t++)
+    {
+        messages.assign(cars, stream[t % stream.size()]);
+        server.Tick(messages, timeout_us);
+
+        if (period.count() == 0)
+            continue;
+
+        next_tick += period;
+        if (steady_clock::now() > next_tick)
+            late_ticks++;
+        else
+            std::this_thread::sleep_until(next_tick);
+    }
+
+    double seconds =
+        duration_cast<microseconds>(steady_clock::now() - start_time).count() /
+        1e6;
+    auto &rtt = server.RoundTrips();
+    server.Shutdown();
+
+    // Whatever was logged goes out before the results.
+    Logger::Get().Flush();
+    printf("cars=%d ticks=%d elapsed_s=%.3f achieved_hz=%.1f\n", cars,
+           ticks - 1, seconds, (ticks - 1) / seconds);
+    printf("rtt_us p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f\n",
+           StandinServer::Percentile(rtt, 0.5f),
+           StandinServer::Percentile(rtt, 0.9f),
+           StandinServer::Percentile(rtt, 0.99f),
+           StandinServer::Percentile(rtt, 0.999f),
+           StandinServer::Percentile(rtt, 1.0f));
+    printf("timeouts=%d late_ticks=%d\n", server.Timeouts(), late_ticks);
+
+    // Unpaced runs are bound by the bot alone, so their rate is the most the
+    // bot sustains; the p99 figure is what it keeps up with 99% of the time.
+    if (period.count() == 0)
+        printf("max_sustainable_hz=%.1f p99_sustainable_hz=%.1f\n",
+               (ticks - 1) / seconds,
+               1e6 / std::max(StandinServer::Percentile(rtt, 0.99f), 1.0f));
+
+    return 0;
+}
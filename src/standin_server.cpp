@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+#include <poll.h>
+
+#include "flight_recorder.h"
+#include "standin_server.h"
+#include "utils.h"
+
+using std::string;
+using namespace std::chrono;
+
+StandinServer::StandinServer(int base_port, int cars)
+    : clients(cars), owed(cars, 0)
+{
+    for (int i = 0; i < cars; i++)
+    {
+        sockets.push_back(std::make_unique<udp::socket>(
+            io_service, udp::endpoint(udp::v4(), base_port + i)));
+        sockets.back()->non_blocking(true);
+    }
+}
+
+int StandinServer::Cars() { return sockets.size(); }
+
+void StandinServer::AwaitClients()
+{
+    std::vector<bool> identified(Cars(), false);
+    std::vector<pollfd> fds(Cars());
+    int left = Cars();
+    char buf[UINT16_MAX];
+
+    for (int i = 0; i < Cars(); i++)
+        fds[i] = pollfd{sockets[i]->native_handle(), POLLIN, 0};
+
+    while (left > 0)
+    {
+        poll(fds.data(), fds.size(), -1);
+
+        for (int i = 0; i < Cars(); i++)
+        {
+            boost::system::error_code ec;
+            size_t len = sockets[i]->receive_from(
+                boost::asio::buffer(buf, sizeof(buf)), clients[i], 0, ec);
+
+            if (ec || strncmp(buf, "SCR(init", std::min<size_t>(len, 8)) != 0)
+                continue;
+
+            sockets[i]->send_to(boost::asio::buffer(string("***identified***")),
+                                clients[i], 0, ec);
+
+            if (!identified[i])
+            {
+                identified[i] = true;
+                left--;
+            }
+        }
+    }
+}
+
+bool StandinServer::Tick(const std::vector<string> &messages, int timeout_us,
+                         bool wait_for_replies)
+{
+    std::vector<bool> replied(Cars(), false);
+    std::vector<pollfd> fds(Cars());
+    int left = Cars();
+    char buf[UINT16_MAX];
+
+    auto sent_time = steady_clock::now();
+
+    for (int i = 0; i < Cars(); i++)
+    {
+        boost::system::error_code ec;
+        sockets[i]->send_to(boost::asio::buffer(messages[i]), clients[i], 0,
+                            ec);
+        fds[i] = pollfd{sockets[i]->native_handle(), POLLIN, 0};
+    }
+
+    if (!wait_for_replies)
+    {
+        for (auto &count : owed)
+            count++;
+        return true;
+    }
+
+    auto deadline = sent_time + microseconds(timeout_us);
+
+    while (left > 0)
+    {
+        auto now = steady_clock::now();
+        if (now >= deadline)
+        {
+            for (int i = 0; i < Cars(); i++)
+                if (!replied[i])
+                    owed[i]++;
+
+            timeouts += left;
+            return false;
+        }
+
+        int wait_ms =
+            duration_cast<milliseconds>(deadline - now).count() + 1;
+        poll(fds.data(), fds.size(), wait_ms);
+
+        for (int i = 0; i < Cars(); i++)
+        {
+            boost::system::error_code ec;
+            udp::endpoint sender;
+
+            if (replied[i] || !(fds[i].revents & POLLIN))
+                continue;
+
+            sockets[i]->receive_from(boost::asio::buffer(buf, sizeof(buf)),
+                                     sender, 0, ec);
+            if (ec)
+                continue;
+
+            if (owed[i] > 0)
+            {
+                owed[i]--;
+                continue;
+            }
+
+            round_trips_us.push_back(
+                duration_cast<nanoseconds>(steady_clock::now() - sent_time)
+                    .count() /
+                1000.0f);
+            replied[i] = true;
+            left--;
+        }
+    }
+
+    return true;
+}
+
+void StandinServer::Shutdown()
+{
+    for (int i = 0; i < Cars(); i++)
+    {
+        boost::system::error_code ec;
+        sockets[i]->send_to(boost::asio::buffer(string("***shutdown***")),
+                            clients[i], 0, ec);
+    }
+}
+
+const std::vector<float> &StandinServer::RoundTrips() { return round_trips_us; }
+
+int StandinServer::Timeouts() { return timeouts; }
+
+void StandinServer::ResetStats()
+{
+    round_trips_us.clear();
+    timeouts = 0;
+}
+
+string StandinServer::EncodeCarState(const CarState &state)
+{
+    char buf[2048];
+    char *cursor = buf;
+
+    // Same field order as scr_server, including the fields the bot skips.
+    cursor += sprintf(cursor,
+                      "(angle %f)(curLapTime %f)(damage 0)(distFromStart %f)"
+                      "(distRaced %f)(fuel 94)(gear %d)(lastLapTime 0)"
+                      "(opponents",
+                      state.angle, state.current_lap_time,
+                      state.absolute_odometer, state.absolute_odometer,
+                      (int)state.gear);
+    for (int i = 0; i < 36; i++)
+        cursor += sprintf(cursor, " 200");
+    cursor += sprintf(cursor,
+                      ")(racePos 1)(rpm %f)(speedX %f)(speedY %f)(speedZ %f)"
+                      "(track",
+                      state.rpm, state.speed_x, state.speed_y, state.speed_z);
+    for (float sensor : state.sensors)
+        cursor += sprintf(cursor, " %f", sensor);
+    cursor += sprintf(cursor, ")(trackPos %f)(wheelSpinVel",
+                      state.cross_position);
+    for (float wheel : state.wheels_speeds)
+        cursor += sprintf(cursor, " %f", wheel);
+    cursor += sprintf(cursor, ")(z %f)(focus -1 -1 -1 -1 -1)", state.height);
+
+    return string(buf, cursor - buf);
+}
+
+std::vector<string> StandinServer::LoadCapture(string filename, int car)
+{
+    std::vector<string> messages;
+    std::vector<FlightRecord> records;
+
+    if (has_suffix(filename, ".hflt"))
+    {
+        if (FlightRecorder::Load(filename, records))
+            for (auto &record : records)
+                if (record.car == car && record.kind == FLIGHT_STATE)
+                    messages.push_back(EncodeCarState(record.State()));
+
+        return messages;
+    }
+
+    std::ifstream fs(filename);
+    string line;
+
+    // One state message per line, control messages are the server's job.
+    while (std::getline(fs, line))
+        if (line.size() > 0 && line[0] == '(')
+            messages.push_back(line);
+
+    return messages;
+}
+
+float StandinServer::Percentile(std::vector<float> samples, float p)
+{
+    if (samples.size() == 0)
+        return 0.0f;
+
+    size_t n = std::min(samples.size() - 1, (size_t)(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + n, samples.end());
+
+    return samples[n];
+}
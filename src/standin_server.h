@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "car_io.h"
+#include "main.h"
+
+// Local replacement for the SCR server side of TORCS. Car i is served on
+// base_port + i, every tick sends one state to each car and waits for the
+// replies, recording the round trip. A bot answers every state in order, so
+// after a timeout its next replies are the late ones and are skipped, not
+// taken for the replies of the ticks after.
+class StandinServer
+{
+    using udp = boost::asio::ip::udp;
+
+    boost::asio::io_service io_service;
+    std::vector<std::unique_ptr<udp::socket>> sockets;
+    std::vector<udp::endpoint> clients;
+
+    // States each car hasn't answered yet from earlier ticks.
+    std::vector<int> owed;
+
+    std::vector<float> round_trips_us;
+    int timeouts = 0;
+
+  public:
+    StandinServer(int base_port, int cars);
+
+    int Cars();
+    void AwaitClients();
+    bool Tick(const std::vector<std::string> &messages, int timeout_us,
+              bool wait_for_replies = true);
+    void Shutdown();
+
+    const std::vector<float> &RoundTrips();
+    int Timeouts();
+    void ResetStats();
+
+    static std::string EncodeCarState(const CarState &state);
+    // The states of a flight recording (.hflt) of the given car, or a text
+    // capture with one SCR state message per line.
+    static std::vector<std::string> LoadCapture(std::string filename,
+                                                int car = 0);
+    static float Percentile(std::vector<float> samples, float p);
+};
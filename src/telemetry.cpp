@@ -0,0 +1,125 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "telemetry.h"
+#include "utils.h"
+
+#define TELEMETRY_POLL_US 500
+#define TELEMETRY_FLUSH_MS 100
+
+TelemetryHub *TelemetryHub::active = nullptr;
+
+TelemetryHub::TelemetryHub()
+{
+    // Races end in exit() from the transport, the consumers still have to
+    // write out what's queued before stdio goes.
+    static bool registered = false;
+    if (!registered)
+        std::atexit([]() {
+            if (active != nullptr)
+                active->Stop();
+        });
+    registered = true;
+
+    active = this;
+}
+
+TelemetryHub::~TelemetryHub()
+{
+    Stop();
+
+    if (active == this)
+        active = nullptr;
+}
+
+void TelemetryHub::Subscribe(
+    std::function<void(const TelemetryRecord &)> handler,
+    std::function<void()> flush, size_t capacity)
+{
+    consumers.emplace_back(new Consumer(capacity));
+
+    auto &consumer = *consumers.back();
+    consumer.handler = handler;
+    consumer.flush = flush;
+    consumer.thread = std::thread(&TelemetryHub::ConsumerLoop, this,
+                                  std::ref(consumer));
+}
+
+// Consumers poll rather than being woken, a wake-up would be a syscall on
+// the control thread.
+void TelemetryHub::ConsumerLoop(Consumer &consumer)
+{
+    auto last_flush = std::chrono::steady_clock::now();
+    TelemetryRecord record;
+    bool pending = false;
+
+    while (true)
+    {
+        bool stopping = stop.load();
+
+        while (consumer.ring.Pop(record))
+        {
+            consumer.handler(record);
+            pending = true;
+        }
+
+        if (stopping)
+            break;
+
+        auto now = std::chrono::steady_clock::now();
+        if (pending && consumer.flush &&
+            now - last_flush > std::chrono::milliseconds(TELEMETRY_FLUSH_MS))
+        {
+            consumer.flush();
+            last_flush = now;
+            pending = false;
+        }
+
+        std::this_thread::sleep_for(
+            std::chrono::microseconds(TELEMETRY_POLL_US));
+    }
+
+    if (consumer.flush)
+        consumer.flush();
+}
+
+void TelemetryHub::Stop()
+{
+    if (stop.exchange(true))
+        return;
+
+    for (auto &consumer : consumers)
+    {
+        consumer->thread.join();
+
+        if (consumer->dropped > 0)
+            log_info("A telemetry consumer dropped " +
+                     std::to_string(consumer->dropped) + " record(s)");
+    }
+}
+
+bool TelemetryHub::SubscribeCsv(std::string filename)
+{
+    FILE *file = fopen(filename.c_str(), "w");
+
+    if (file == nullptr)
+        return false;
+
+    fprintf(file, "ns,car,current_hinge,odometer,lateral_target,"
+                  "heading_target,steering,gas,target_speed\n");
+
+    // The handle is shared by the two callbacks and closed with the last.
+    auto handle = std::shared_ptr<FILE>(file, fclose);
+
+    Subscribe(
+        [handle](const TelemetryRecord &r) {
+            fprintf(handle.get(), "%lu,%d,%d,%f,%f,%f,%f,%f,%f\n",
+                    (unsigned long)r.ns, r.car, r.current_hinge, r.odometer,
+                    r.lateral_target, r.heading_target, r.steering, r.gas,
+                    r.target_speed);
+        },
+        [handle]() { fflush(handle.get()); });
+
+    return true;
+}
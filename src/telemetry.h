@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spsc_ring.h"
+
+// One control cycle as seen from outside.
+struct TelemetryRecord
+{
+    uint64_t ns;
+    int car, current_hinge;
+    float odometer;
+    float lateral_target, heading_target;
+    float steering, gas, target_speed;
+};
+
+// Fans telemetry out from the control thread to any number of consumers.
+// Every consumer gets its own SPSC ring and thread; publishing is one Push
+// per consumer, and a consumer that falls behind loses records instead of
+// holding the loop up. Subscribe before the first Publish.
+class TelemetryHub
+{
+    struct Consumer
+    {
+        SpscRing<TelemetryRecord> ring;
+        std::function<void(const TelemetryRecord &)> handler;
+        std::function<void()> flush;
+        std::atomic<uint64_t> dropped{0};
+        std::thread thread;
+
+        Consumer(size_t capacity) : ring(capacity) {}
+    };
+
+    std::vector<std::unique_ptr<Consumer>> consumers;
+    std::atomic<bool> stop{false};
+
+    // The hub stopped at exit, the latest one made.
+    static TelemetryHub *active;
+
+    void ConsumerLoop(Consumer &consumer);
+
+  public:
+    TelemetryHub();
+    ~TelemetryHub();
+
+    void Subscribe(std::function<void(const TelemetryRecord &)> handler,
+                   std::function<void()> flush = nullptr,
+                   size_t capacity = 4096);
+
+    void Publish(const TelemetryRecord &record)
+    {
+        for (auto &consumer : consumers)
+            if (!consumer->ring.Push(record))
+                consumer->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Drains what's left and joins the consumers.
+    void Stop();
+
+    // A consumer writing every record as a CSV line to filename.
+    bool SubscribeCsv(std::string filename);
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs a batch of tasks on a fixed set of threads. Each worker owns a deque,
+// pops its own tasks from the front and, once it runs dry, steals from the
+// back of the others', so uneven task lengths don't leave cores idle.
+class WorkStealingPool
+{
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    int threads;
+
+    static bool Pop(Queue &queue, std::function<void()> &task, bool back)
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+
+        if (queue.tasks.empty())
+            return false;
+
+        task = std::move(back ? queue.tasks.back() : queue.tasks.front());
+        back ? queue.tasks.pop_back() : queue.tasks.pop_front();
+        return true;
+    }
+
+  public:
+    WorkStealingPool(int threads = 0)
+        : threads(threads > 0 ? threads
+                              : std::max(1u, std::thread::hardware_concurrency()))
+    {
+    }
+
+    int Threads() { return threads; }
+
+    void Run(std::vector<std::function<void()>> tasks)
+    {
+        std::vector<Queue> queues(threads);
+        std::vector<std::thread> workers;
+
+        for (int i = 0; i < tasks.size(); i++)
+            queues[i % threads].tasks.push_back(std::move(tasks[i]));
+
+        for (int w = 0; w < threads; w++)
+        {
+            workers.emplace_back([&queues, w, this]() {
+                std::function<void()> task;
+
+                while (true)
+                {
+                    bool found = Pop(queues[w], task, false);
+
+                    for (int v = 1; !found && v < threads; v++)
+                        found = Pop(queues[(w + v) % threads], task, true);
+
+                    // Nothing is ever added during a run, empty means done.
+                    if (!found)
+                        return;
+
+                    task();
+                }
+            });
+        }
+
+        for (auto &worker : workers)
+            worker.join();
+    }
+};
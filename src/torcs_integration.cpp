@@ -1,11 +1,11 @@
 #include <climits>
-#include <thread>
+#include <functional>
 #include <unordered_map>
 
 #include "main.h"
+#include "latency_stats.h"
 #include "torcs_integration.h"
 
-using namespace std::chrono_literals;
 using std::string;
 
 // clang-format off
@@ -35,18 +35,40 @@ TorcsIntegration::TorcsIntegration(stringmap params)
     else
         assert(false);
 
-    udp::resolver resolver(io_service);
-    udp::resolver::query query(udp::v4(), params["host"], "87623");
-    server_endpoint = *resolver.resolve(query);
+    server_endpoint = ResolveEndpoint(io_service, params["host"],
+                                      std::stoi(params["server_port"]));
 
     assert(server_endpoint.address().to_string() != "");
 
+    handshake_retry =
+        std::chrono::microseconds(std::stoi(params["handshake_retry_us"]));
+    handshake_retry_max =
+        std::chrono::microseconds(std::stoi(params["handshake_retry_max_us"]));
+    handshake_timeout =
+        std::chrono::milliseconds(std::stoi(params["handshake_timeout_ms"]));
+
     socket = std::make_unique<udp::socket>(io_service,
                                            udp::endpoint(udp::v4(), port));
 
     socket->non_blocking(true);
 }
 
+boost::asio::ip::udp::endpoint
+TorcsIntegration::ResolveEndpoint(boost::asio::io_service &io_service,
+                                  string host, int port)
+{
+    boost::system::error_code ec;
+    auto address = boost::asio::ip::make_address_v4(host, ec);
+
+    // Only names that aren't already an address go through the resolver.
+    if (!ec)
+        return udp::endpoint(address, port);
+
+    udp::resolver resolver(io_service);
+    udp::resolver::query query(udp::v4(), host, std::to_string(port));
+    return *resolver.resolve(query);
+}
+
 CarState TorcsIntegration::ParseCarState(std::string in)
 {
     CarState out;
@@ -106,10 +128,9 @@ string TorcsIntegration::ParseString(char **cursor)
     return out;
 }
 
-CarState TorcsIntegration::Begin(stringmap params)
+string TorcsIntegration::EncodeInitString(stringmap params)
 {
-    string init_string = "SCR(init", instring;
-    string in_msg;
+    string init_string = "SCR(init";
 
     for (int i = -9; i <= 9; i++)
     {
@@ -117,25 +138,97 @@ CarState TorcsIntegration::Begin(stringmap params)
     }
     init_string += ")";
 
-    while (true)
-    {
-        do
-        {
-            Send(init_string);
-            std::this_thread::sleep_for(1s);
-        } while ((in_msg = Receive()).length() == 0);
+    return init_string;
+}
 
-        if (in_msg == "***identified***")
-        {
-            break;
-        }
-        else
-        {
-            log_warning("Communication error on init!");
-            throw;
-        }
+string TorcsIntegration::EncodeCarSteers(const CarSteers &steers)
+{
+    string out;
+
+    out += "(accel " + std::to_string(steers.gas) + ")";
+    out += "(brake " + std::to_string(steers.hand_brake) + ")";
+    out += "(gear " + std::to_string(steers.gear) + ")";
+    out += "(clutch " + std::to_string(steers.clutch) + ")";
+    out += "(steer " + std::to_string(steers.steering_wheel) + ")";
+    // out += "(focus " + std::to_string(steers.focus) + ")";
+    // out += "(meta " + std::to_string(steers.gas) + ")";
+
+    return out;
+}
+
+CarState TorcsIntegration::Begin(stringmap params)
+{
+    string init_string = EncodeInitString(params);
+    string in_msg;
+    bool identified = false;
+    auto retry = handshake_retry;
+
+    boost::asio::steady_timer retry_timer(io_service);
+    boost::asio::steady_timer deadline_timer(io_service);
+    boost::array<char, UINT16_MAX> recv_buf;
+    udp::endpoint sender;
+
+    // Keep re-sending the init with a growing backoff until the server
+    // identifies us, so a server that comes up a moment after the bot costs
+    // only that moment. The backoff is capped in the tens of milliseconds:
+    // a server that's bound but not reading yet takes every queued init for
+    // a control reply later on.
+    std::function<void()> send_init = [&]() {
+        Send(init_string);
+        retry_timer.expires_after(retry);
+        retry = std::min(retry * 2, handshake_retry_max);
+        retry_timer.async_wait([&](const boost::system::error_code &ec) {
+            // An expiry already queued when the timer got cancelled still
+            // arrives without an error.
+            if (!ec && !identified)
+                send_init();
+        });
+    };
+
+    std::function<void()> receive_identified = [&]() {
+        socket->async_receive_from(
+            boost::asio::buffer(recv_buf), sender,
+            [&](const boost::system::error_code &ec, size_t len) {
+                if (ec == boost::asio::error::operation_aborted)
+                    return;
+
+                if (!ec && string(recv_buf.data(), len) == "***identified***")
+                {
+                    identified = true;
+                    server_endpoint = sender;
+                    retry_timer.cancel();
+                    deadline_timer.cancel();
+                    return;
+                }
+
+                if (!ec)
+                    log_warning("Communication error on init!");
+                receive_identified();
+            });
+    };
+
+    if (handshake_timeout.count() > 0)
+    {
+        deadline_timer.expires_after(handshake_timeout);
+        deadline_timer.async_wait([&](const boost::system::error_code &ec) {
+            if (ec || identified)
+                return;
+
+            retry_timer.cancel();
+            socket->cancel();
+        });
     }
 
+    send_init();
+    receive_identified();
+
+    io_service.restart();
+    io_service.run();
+
+    if (!identified)
+        log_error("No answer from the simulator in " +
+                  std::to_string(handshake_timeout.count()) + " ms!");
+
     while ((in_msg = Receive()).length() == 0)
         ;
 
@@ -150,23 +243,28 @@ CarState TorcsIntegration::Begin(stringmap params)
 
 CarState TorcsIntegration::Cycle(const CarSteers &steers)
 {
-    string out, in;
+    string in, out;
 
-    out += "(accel " + std::to_string(steers.gas) + ")";
-    out += "(brake " + std::to_string(steers.hand_brake) + ")";
-    out += "(gear " + std::to_string(steers.gear) + ")";
-    out += "(clutch " + std::to_string(steers.clutch) + ")";
-    out += "(steer " + std::to_string(steers.steering_wheel) + ")";
-    // out += "(focus " + std::to_string(steers.focus) + ")";
-    // out += "(meta " + std::to_string(steers.gas) + ")";
+    {
+        LatencyTimer timer(STAGE_ENCODE);
+        out = EncodeCarSteers(steers);
+    }
 
-    while ((in = Receive()).length() == 0)
-        ;
+    // Answer the state the steers were computed from before waiting for the
+    // next one, otherwise the server sits in its reply timeout every tick.
+    {
+        LatencyTimer timer(STAGE_SEND);
+        Send(out);
+    }
 
-    auto state = ParseCarState(in);
-    Send(out);
+    {
+        LatencyTimer timer(STAGE_RECEIVE);
+        while ((in = Receive()).length() == 0)
+            ;
+    }
 
-    return state;
+    LatencyTimer timer(STAGE_PARSE);
+    return ParseCarState(in);
 }
 
 std::string TorcsIntegration::Receive()
@@ -174,6 +272,7 @@ std::string TorcsIntegration::Receive()
     boost::system::error_code ec;
 
     boost::array<char, UINT16_MAX> recv_buf;
+    receive_calls++;
     size_t len = socket->receive_from(boost::asio::buffer(recv_buf),
                                       server_endpoint, 0, ec);
 
@@ -187,6 +286,7 @@ void TorcsIntegration::Send(std::string msg)
 {
     boost::system::error_code ignored_error;
     std::vector<char> send_buf(msg.begin(), msg.end());
+    send_calls++;
     socket->send_to(boost::asio::buffer(send_buf), server_endpoint, 0,
                     ignored_error);
 }
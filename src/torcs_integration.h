@@ -1,5 +1,7 @@
 #pragma once
 
+#include <chrono>
+
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
 
@@ -8,10 +10,22 @@
 
 class SimIntegration
 {
+    CarSteers pending_steers;
+
   public:
     virtual CarState Begin(stringmap driver_params) = 0;
     virtual CarState Cycle(const CarSteers &) = 0;
 
+    // Two-phase form of Cycle(), lets several cars share one flush.
+    virtual void Submit(const CarSteers &steers) { pending_steers = steers; }
+    virtual CarState Collect() { return Cycle(pending_steers); }
+
+    // Simulators that end the session on their own, without ***shutdown***.
+    virtual bool Finished() { return false; }
+
+    // Touches the buffers the cycle receives into, returns the bytes covered.
+    virtual size_t Prefault() { return 0; }
+
     virtual ~SimIntegration() = default;
 };
 
@@ -22,13 +36,23 @@ class TorcsIntegration : public SimIntegration
     boost::asio::io_service io_service;
     std::unique_ptr<udp::socket> socket;
 
-    CarState ParseCarState(std::string in);
-    std::string ParseString(char **cursor);
+    std::chrono::microseconds handshake_retry, handshake_retry_max;
+    std::chrono::milliseconds handshake_timeout;
+
+    static std::string ParseString(char **cursor);
 
     void Send(std::string msg);
     std::string Receive();
 
   public:
+    uint64_t receive_calls = 0, send_calls = 0;
+
+    static udp::endpoint ResolveEndpoint(boost::asio::io_service &io_service,
+                                         std::string host, int port);
+    static CarState ParseCarState(std::string in);
+    static std::string EncodeCarSteers(const CarSteers &steers);
+    static std::string EncodeInitString(stringmap driver_params);
+
     virtual CarState Cycle(const CarSteers &) override;
     virtual CarState Begin(stringmap driver_params) override;
 
@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "track_codec.h"
+
+// Quotients this long are written as 64 raw bits instead.
+#define TRACK_CODEC_ESCAPE 24
+#define TRACK_CODEC_ZERO_BLOCK 31
+
+using Waypoint = HingyTrack::Waypoint;
+
+static uint64_t zigzag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static int64_t quantize(float value)
+{
+    return std::llround((double)value * TRACK_CODEC_SCALE);
+}
+
+// Divided rather than multiplied by the inverse, so a value comes back as
+// the same float atof gives for its XML text.
+static float dequantize(int64_t value)
+{
+    return (float)(value / TRACK_CODEC_SCALE);
+}
+
+static size_t rice_bits(uint64_t value, int k)
+{
+    uint64_t quotient = value >> k;
+    return quotient < TRACK_CODEC_ESCAPE ? quotient + 1 + k
+                                         : TRACK_CODEC_ESCAPE + 64;
+}
+
+class RiceWriter
+{
+    std::vector<uint8_t> &out;
+    uint64_t bits = 0;
+    int count = 0;
+
+  public:
+    RiceWriter(std::vector<uint8_t> &out) : out(out) {}
+
+    // Up to 32 bits, least significant first.
+    void Put(uint64_t value, int width)
+    {
+        bits |= (value & ((1ull << width) - 1)) << count;
+        count += width;
+
+        while (count >= 8)
+        {
+            out.push_back(bits);
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    void Rice(uint64_t value, int k)
+    {
+        uint64_t quotient = value >> k;
+
+        if (quotient < TRACK_CODEC_ESCAPE)
+        {
+            Put((1ull << quotient) - 1, quotient + 1);
+            Put(value, k);
+        }
+        else
+        {
+            Put((1ull << TRACK_CODEC_ESCAPE) - 1, TRACK_CODEC_ESCAPE);
+            Put(value, 32);
+            Put(value >> 32, 32);
+        }
+    }
+
+    void Finish()
+    {
+        if (count > 0)
+            out.push_back(bits);
+        count = 0;
+    }
+};
+
+class RiceReader
+{
+    const uint8_t *next, *end;
+    uint64_t bits = 0;
+    int count = 0;
+    // Bits taken past the end, read as zeros.
+    size_t overrun = 0;
+
+    // Tops the buffer up to at least 56 bits, a word at a time while
+    // there's a word left.
+    void Refill()
+    {
+        if (end - next >= 8)
+        {
+            uint64_t word;
+            memcpy(&word, next, 8);
+            bits |= word << count;
+            next += (63 - count) >> 3;
+            count |= 56;
+            return;
+        }
+
+        while (count <= 56)
+        {
+            if (next < end)
+                bits |= (uint64_t)*next++ << count;
+            else
+                overrun += 8;
+            count += 8;
+        }
+    }
+
+  public:
+    RiceReader(const uint8_t *data, size_t size)
+        : next(data), end(data + size)
+    {
+    }
+
+    uint64_t Get(int width)
+    {
+        if (count < width)
+            Refill();
+
+        uint64_t value = bits & ((1ull << width) - 1);
+        bits >>= width;
+        count -= width;
+        return value;
+    }
+
+    uint64_t Rice(int k)
+    {
+        if (count < TRACK_CODEC_ESCAPE + 1 + k)
+            Refill();
+
+        int quotient = ~bits ? __builtin_ctzll(~bits) : 64;
+
+        if (quotient >= TRACK_CODEC_ESCAPE)
+        {
+            bits >>= TRACK_CODEC_ESCAPE;
+            count -= TRACK_CODEC_ESCAPE;
+            uint64_t low = Get(32);
+            return low | Get(32) << 32;
+        }
+
+        bits >>= quotient + 1;
+        count -= quotient + 1;
+        return (uint64_t)quotient << k | Get(k);
+    }
+
+    // Whether everything read was in the data.
+    bool Intact() const { return overrun <= (size_t)count; }
+};
+
+// Guesses a value from the two before it, as the previous value or as the
+// line through both.
+static int64_t predict(int order, int64_t last, int64_t before_last)
+{
+    return order == 0 ? last : 2 * last - before_last;
+}
+
+// A field block by block, each with the predictor and Rice parameter that
+// take the fewest bits.
+static void encode_field(const std::vector<int64_t> &field,
+                         RiceWriter &writer)
+{
+    std::vector<uint64_t> residuals[2];
+
+    for (size_t begin = 0; begin < field.size(); begin += TRACK_CODEC_BLOCK)
+    {
+        size_t end = std::min(begin + TRACK_CODEC_BLOCK, field.size());
+        int best_order = 0, best_k = 0;
+        size_t best_bits = SIZE_MAX;
+
+        for (int order = 0; order < 2; order++)
+        {
+            residuals[order].clear();
+            for (size_t i = begin; i < end; i++)
+            {
+                int64_t last = i > 0 ? field[i - 1] : 0;
+                int64_t before_last = i > 1 ? field[i - 2] : 0;
+                residuals[order].push_back(
+                    zigzag(field[i] - predict(order, last, before_last)));
+            }
+
+            if (std::all_of(residuals[order].begin(), residuals[order].end(),
+                            [](uint64_t value) { return value == 0; }))
+            {
+                best_order = order;
+                best_k = TRACK_CODEC_ZERO_BLOCK;
+                break;
+            }
+
+            for (int k = 0; k < TRACK_CODEC_ZERO_BLOCK; k++)
+            {
+                size_t bits = 0;
+                for (auto value : residuals[order])
+                    bits += rice_bits(value, k);
+
+                if (bits < best_bits)
+                {
+                    best_bits = bits;
+                    best_order = order;
+                    best_k = k;
+                }
+            }
+        }
+
+        writer.Put(best_order, 1);
+        writer.Put(best_k, 5);
+        if (best_k != TRACK_CODEC_ZERO_BLOCK)
+            for (auto value : residuals[best_order])
+                writer.Rice(value, best_k);
+    }
+}
+
+std::vector<uint8_t> encode_track(const std::vector<Waypoint> &waypoints)
+{
+    TrackCodecHeader header{TRACK_CODEC_MAGIC, TRACK_CODEC_VERSION,
+                            waypoints.size()};
+    std::vector<uint8_t> out((const uint8_t *)&header,
+                             (const uint8_t *)(&header + 1));
+    RiceWriter writer(out);
+    std::vector<int64_t> field(waypoints.size());
+
+    for (auto member : {&Waypoint::f, &Waypoint::a, &Waypoint::l})
+    {
+        for (size_t i = 0; i < waypoints.size(); i++)
+            field[i] = quantize(waypoints[i].*member);
+        encode_field(field, writer);
+    }
+
+    for (size_t i = 0; i < waypoints.size(); i++)
+        field[i] = quantize(waypoints[i].r) + quantize(waypoints[i].l);
+    encode_field(field, writer);
+
+    writer.Finish();
+    return out;
+}
+
+// Decodes a field into the waypoints, each value plus offset[i] when
+// given. The field itself is kept in values.
+static void decode_field(RiceReader &reader, std::vector<Waypoint> &waypoints,
+                         float Waypoint::*member, std::vector<int64_t> &values,
+                         const int64_t *offset)
+{
+    size_t count = waypoints.size();
+    int64_t last = 0, before_last = 0;
+
+    for (size_t begin = 0; begin < count; begin += TRACK_CODEC_BLOCK)
+    {
+        size_t end = std::min(begin + TRACK_CODEC_BLOCK, count);
+        int order = reader.Get(1);
+        int k = reader.Get(5);
+
+        for (size_t i = begin; i < end; i++)
+        {
+            int64_t residual =
+                k == TRACK_CODEC_ZERO_BLOCK ? 0 : unzigzag(reader.Rice(k));
+            int64_t value = predict(order, last, before_last) + residual;
+
+            before_last = last;
+            values[i] = last = value;
+            waypoints[i].*member = dequantize(offset ? value + offset[i] : value);
+        }
+    }
+}
+
+bool decode_track(const uint8_t *data, size_t size,
+                  std::vector<Waypoint> &waypoints)
+{
+    TrackCodecHeader header;
+    waypoints.clear();
+
+    if (size < sizeof(header))
+        return false;
+
+    memcpy(&header, data, sizeof(header));
+
+    // Every block of the four fields takes at least 6 bits.
+    size_t blocks = (size - sizeof(header)) * 8 / 6 / 4;
+    if (header.magic != TRACK_CODEC_MAGIC ||
+        header.version != TRACK_CODEC_VERSION ||
+        header.waypoints > blocks * TRACK_CODEC_BLOCK)
+        return false;
+
+    RiceReader reader(data + sizeof(header), size - sizeof(header));
+    std::vector<int64_t> values(header.waypoints), left(header.waypoints);
+    waypoints.resize(header.waypoints);
+
+    decode_field(reader, waypoints, &Waypoint::f, values, NULL);
+    decode_field(reader, waypoints, &Waypoint::a, values, NULL);
+    decode_field(reader, waypoints, &Waypoint::l, left, NULL);
+
+    for (auto &value : left)
+        value = -value;
+    decode_field(reader, waypoints, &Waypoint::r, values, left.data());
+
+    if (!reader.Intact())
+    {
+        waypoints.clear();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "hingy_track.h"
+
+#define TRACK_CODEC_MAGIC 0x4b525448 // "HTRK"
+#define TRACK_CODEC_VERSION 1
+#define TRACK_CODEC_SUFFIX ".htrk"
+// Fields are stored in millionths, the precision of the XML tracks.
+#define TRACK_CODEC_SCALE 1e6
+// Values per Rice parameter.
+#define TRACK_CODEC_BLOCK 128
+
+struct TrackCodecHeader
+{
+    uint32_t magic, version;
+    uint64_t waypoints;
+};
+
+// The header, then forward, angle, left and right + left one after
+// another. Each is coded in blocks of TRACK_CODEC_BLOCK as the zigzagged
+// residuals of a prediction from the two values before. A block is led by
+// a bit picking the previous value or the line through the last two as the
+// prediction, then by its Rice parameter in 5 bits, 31 when every residual
+// is zero and none follow.
+std::vector<uint8_t>
+encode_track(const std::vector<HingyTrack::Waypoint> &waypoints);
+
+// Replaces waypoints with the decoded track. False when the data is
+// malformed, waypoints are then left empty.
+bool decode_track(const uint8_t *data, size_t size,
+                  std::vector<HingyTrack::Waypoint> &waypoints);
@@ -0,0 +1,36 @@
+#include <cstdio>
+
+#include "hingy_track.h"
+#include "logger.h"
+#include "utils.h"
+
+// Rewrites a track in the format its new name asks for, e.g.
+// tracks/speed.xml tracks/speed.htrk, or back.
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s <track in> <track out>\n", argv[0]);
+        return 1;
+    }
+
+    HingyTrack track(argv[1]);
+
+    if (track.GetWaypoints().size() == 0)
+    {
+        fprintf(stderr, "%s has no waypoints\n", argv[1]);
+        return 1;
+    }
+
+    if (!track.SaveWaypoints(argv[2]))
+    {
+        fprintf(stderr, "couldn't write %s\n", argv[2]);
+        return 1;
+    }
+
+    // Whatever was logged goes out before the results.
+    Logger::Get().Flush();
+    printf("%zu waypoints, %zu -> %zu bytes\n", track.GetWaypoints().size(),
+           file_size(argv[1]), file_size(argv[2]));
+    return 0;
+}
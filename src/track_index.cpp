@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+
+#include <sys/stat.h>
+
+#include "thread_pool.h"
+#include "track_codec.h"
+#include "track_index.h"
+#include "utils.h"
+
+using std::string;
+
+void TrackObservation::Add(float odometer, float angle)
+{
+    if (started && last - odometer > 60.0f)
+    {
+        started = false;
+        turns.clear();
+    }
+    last = odometer;
+
+    int at = std::floor((odometer - TRACK_INDEX_START) / TRACK_INDEX_STEP);
+
+    if (!started)
+    {
+        started = true;
+        first = at + 1;
+        sample = at;
+        turn = 0.0f;
+    }
+
+    if (at != sample)
+    {
+        if (sample >= first)
+            turns.push_back(turn);
+        sample = at;
+        turn = 0.0f;
+    }
+
+    turn += angle;
+}
+
+int TrackObservation::First() const { return first; }
+
+float TrackObservation::Distance() const
+{
+    return turns.size() * TRACK_INDEX_STEP;
+}
+
+TrackIndex::Entry TrackIndex::Signature(const string &file, uint64_t size,
+                                        uint64_t mtime)
+{
+    HingyTrack track(file);
+    Entry entry{file, size, mtime, {}};
+    std::vector<float> turns;
+    float odometer = 0.0f;
+
+    for (const auto &waypoint : track.GetWaypoints())
+    {
+        odometer += waypoint.f;
+        size_t at = odometer / TRACK_INDEX_STEP;
+        if (turns.size() <= at)
+            turns.resize(at + 1, 0.0f);
+        turns[at] += waypoint.a;
+    }
+
+    for (float turn : turns)
+        entry.turns.push_back(
+            std::max(-32767.0f,
+                     std::min(std::round(turn * TRACK_INDEX_SCALE), 32767.0f)));
+
+    return entry;
+}
+
+bool TrackIndex::Load(const string &filename)
+{
+    FILE *f = fopen(filename.c_str(), "rb");
+    uint32_t header[3];
+
+    if (f == NULL)
+        return false;
+
+    bool read = fread(header, sizeof(header), 1, f) == 1 &&
+                header[0] == TRACK_INDEX_MAGIC &&
+                header[1] == TRACK_INDEX_VERSION;
+
+    for (uint32_t i = 0; read && i < header[2]; i++)
+    {
+        Entry entry;
+        uint32_t name, samples;
+
+        read = fread(&name, sizeof(name), 1, f) == 1 && name < 4096;
+        entry.file.resize(name);
+        read = read && (name == 0 || fread(&entry.file[0], name, 1, f) == 1) &&
+               fread(&entry.size, sizeof(entry.size), 1, f) == 1 &&
+               fread(&entry.mtime, sizeof(entry.mtime), 1, f) == 1 &&
+               fread(&samples, sizeof(samples), 1, f) == 1 &&
+               samples < (1 << 24);
+
+        if (read)
+        {
+            entry.turns.resize(samples);
+            read = samples == 0 || fread(entry.turns.data(),
+                                         samples * sizeof(int16_t), 1, f) == 1;
+        }
+
+        if (read)
+            entries.push_back(std::move(entry));
+    }
+
+    fclose(f);
+    if (!read)
+        entries.clear();
+    return read;
+}
+
+bool TrackIndex::Save(const string &filename) const
+{
+    if (filename.find('/') != string::npos)
+        mkdir(filename.substr(0, filename.rfind('/')).c_str(), 0755);
+
+    // Written next to it and renamed, readers never see half a file.
+    string tmp = filename + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (f == NULL)
+        return false;
+
+    uint32_t header[3] = {TRACK_INDEX_MAGIC, TRACK_INDEX_VERSION,
+                          (uint32_t)entries.size()};
+    bool written = fwrite(header, sizeof(header), 1, f) == 1;
+
+    for (const auto &entry : entries)
+    {
+        uint32_t name = entry.file.size(), samples = entry.turns.size();
+
+        written = written && fwrite(&name, sizeof(name), 1, f) == 1 &&
+                  fwrite(entry.file.data(), 1, name, f) == name &&
+                  fwrite(&entry.size, sizeof(entry.size), 1, f) == 1 &&
+                  fwrite(&entry.mtime, sizeof(entry.mtime), 1, f) == 1 &&
+                  fwrite(&samples, sizeof(samples), 1, f) == 1 &&
+                  fwrite(entry.turns.data(), sizeof(int16_t), samples, f) ==
+                      samples;
+    }
+
+    written = fclose(f) == 0 && written;
+
+    if (!written || rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        remove(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+TrackIndex TrackIndex::Open(const string &dir, const string &cache,
+                            int threads)
+{
+    std::vector<string> files = list_files(dir, ".xml");
+    for (auto &file : list_files(dir, TRACK_CODEC_SUFFIX))
+        files.push_back(file);
+    std::sort(files.begin(), files.end());
+
+    TrackIndex cached, index;
+    cached.Load(cache);
+
+    std::map<string, const Entry *> known;
+    for (const auto &entry : cached.entries)
+        known[entry.file] = &entry;
+
+    index.entries.resize(files.size());
+    std::vector<std::function<void()>> tasks;
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        struct stat stat_buf;
+        if (stat(files[i].c_str(), &stat_buf) != 0)
+            continue;
+
+        uint64_t size = stat_buf.st_size, mtime = stat_buf.st_mtime;
+        auto entry = known.find(files[i]);
+
+        if (entry != known.end() && entry->second->size == size &&
+            entry->second->mtime == mtime)
+            index.entries[i] = *entry->second;
+        else
+            tasks.push_back([&index, &files, i, size, mtime]() {
+                index.entries[i] = Signature(files[i], size, mtime);
+            });
+    }
+
+    bool stale = tasks.size() > 0 || cached.entries.size() != files.size();
+    WorkStealingPool(threads).Run(std::move(tasks));
+
+    // Gone between listing and stat.
+    index.entries.erase(std::remove_if(index.entries.begin(),
+                                       index.entries.end(),
+                                       [](const Entry &entry) {
+                                           return entry.turns.empty();
+                                       }),
+                        index.entries.end());
+
+    if (stale && !index.Save(cache))
+        log_warning("Couldn't write the track index " + cache);
+
+    return index;
+}
+
+size_t TrackIndex::Size() const { return entries.size(); }
+
+const string &TrackIndex::File(int track) const { return entries[track].file; }
+
+TrackIndex::Match TrackIndex::Find(const TrackObservation &observation) const
+{
+    Match match;
+    match.distance = match.runner_up = INFINITY;
+
+    size_t count = observation.turns.size();
+    if (count == 0)
+        return match;
+
+    std::vector<float> observed;
+    for (float turn : observation.turns)
+        observed.push_back(turn * TRACK_INDEX_SCALE);
+
+    int slack = std::ceil(TRACK_INDEX_SLACK / TRACK_INDEX_STEP);
+
+    for (size_t track = 0; track < entries.size(); track++)
+    {
+        const std::vector<int16_t> &turns = entries[track].turns;
+        int samples = turns.size();
+        float best = INFINITY;
+
+        for (int shift = -slack; shift <= slack; shift++)
+        {
+            int at = ((observation.First() + shift) % samples + samples) %
+                     samples;
+            // Only whether it beats the runner up matters.
+            float bound = std::min(best, match.runner_up) * count;
+            float sum = 0.0f;
+
+            for (size_t j = 0; j < count && sum < bound; j++)
+            {
+                float difference = observed[j] - turns[at];
+                sum += difference * difference;
+                if (++at == samples)
+                    at = 0;
+            }
+
+            best = std::min(best, sum / count);
+        }
+
+        if (best < match.distance)
+        {
+            match.runner_up = match.distance;
+            match.distance = best;
+            match.track = track;
+        }
+        else if (best < match.runner_up)
+        {
+            match.runner_up = best;
+        }
+    }
+
+    float scale = TRACK_INDEX_SCALE * TRACK_INDEX_SCALE;
+    match.distance /= scale;
+    match.runner_up /= scale;
+    return match;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "hingy_track.h"
+
+#define TRACK_INDEX_MAGIC 0x58495448 // "HTIX"
+#define TRACK_INDEX_VERSION 1
+// Odometer covered by each sample of a signature.
+#define TRACK_INDEX_STEP 4.0f
+// Turns are kept in 1e-5 units of waypoint angle.
+#define TRACK_INDEX_SCALE 1e5f
+// Recordings start this far past the start line, see MarkWaypoint.
+#define TRACK_INDEX_START 50.0f
+// How far the start of the observation may be off, either way.
+#define TRACK_INDEX_SLACK 24.0f
+// A match is sure once the next best track is this many times further off.
+#define TRACK_INDEX_MARGIN 2.0f
+
+// The turn over every TRACK_INDEX_STEP of odometer, as it comes in from the
+// wheel speeds. Samples are counted from TRACK_INDEX_START like the lap's
+// own, the one it started in part way through is left out. Starts over when
+// the odometer jumps back at the start line, so a car on the grid behind it
+// only counts from there.
+class TrackObservation
+{
+    float last = 0.0f, turn = 0.0f;
+    int first = 0, sample = 0;
+    bool started = false;
+
+  public:
+    // From sample First() on.
+    std::vector<float> turns;
+
+    void Add(float odometer, float angle);
+    int First() const;
+    float Distance() const;
+};
+
+// Curvature signatures of a library of tracks, the turn over every
+// TRACK_INDEX_STEP of a lap. Looking up an observation only compares it at
+// the offsets the start line allows, so it costs microseconds per track.
+class TrackIndex
+{
+    struct Entry
+    {
+        std::string file;
+        uint64_t size, mtime;
+        std::vector<int16_t> turns;
+    };
+
+    std::vector<Entry> entries;
+
+    static Entry Signature(const std::string &file, uint64_t size,
+                           uint64_t mtime);
+    bool Load(const std::string &filename);
+    bool Save(const std::string &filename) const;
+
+  public:
+    struct Match
+    {
+        int track = -1;
+        // Mean squared difference per sample, for the best and the next best
+        // track.
+        float distance = 0.0f, runner_up = 0.0f;
+    };
+
+    // Every .xml and .htrk track in dir, the signatures read from cache when
+    // it has them for these files, rebuilt in parallel and saved there
+    // otherwise.
+    static TrackIndex Open(const std::string &dir, const std::string &cache,
+                           int threads = 0);
+
+    size_t Size() const;
+    const std::string &File(int track) const;
+    Match Find(const TrackObservation &observation) const;
+};
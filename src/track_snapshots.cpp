@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+
+#include <sys/stat.h>
+
+#include "track_snapshots.h"
+#include "utils.h"
+
+#define SNAPSHOT_QUEUE_LIMIT 16
+#define SNAPSHOT_MARGIN 20.0f
+
+OffscreenRenderer::OffscreenRenderer(int width, int height)
+    : width(width), height(height), pixels(width * height * 3)
+{
+}
+
+void OffscreenRenderer::Fit(const TrackGeometry &geometry)
+{
+    float min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX;
+
+    auto extend = [&](const Vector2D &p) {
+        min_x = std::min(min_x, p.x);
+        min_y = std::min(min_y, p.y);
+        max_x = std::max(max_x, p.x);
+        max_y = std::max(max_y, p.y);
+    };
+
+    for (auto &p : geometry.path)
+        extend(p);
+    for (auto &bound : geometry.bounds)
+    {
+        extend(bound.first);
+        extend(bound.second);
+    }
+    for (auto &p : geometry.hinges)
+        extend(p);
+
+    if (min_x > max_x)
+        return;
+
+    scale = std::min((width - 2.0f * SNAPSHOT_MARGIN) /
+                         std::max(max_x - min_x, 1.0f),
+                     (height - 2.0f * SNAPSHOT_MARGIN) /
+                         std::max(max_y - min_y, 1.0f));
+    offset_x = width / 2.0f - (min_x + max_x) / 2.0f * scale;
+    offset_y = height / 2.0f - (min_y + max_y) / 2.0f * scale;
+}
+
+void OffscreenRenderer::Clear() { std::fill(pixels.begin(), pixels.end(), 0); }
+
+void OffscreenRenderer::DrawLine(Vector2D a, Vector2D b, uint8_t r, uint8_t g,
+                                 uint8_t bl)
+{
+    float ax = a.x * scale + offset_x, ay = a.y * scale + offset_y;
+    float bx = b.x * scale + offset_x, by = b.y * scale + offset_y;
+    int steps = std::ceil(std::max(std::abs(bx - ax), std::abs(by - ay)));
+
+    for (int i = 0; i <= steps; i++)
+    {
+        float t = steps ? (float)i / steps : 0.0f;
+        int x = std::lround(ax + (bx - ax) * t);
+        int y = std::lround(ay + (by - ay) * t);
+
+        if (x < 0 || y < 0 || x >= width || y >= height)
+            continue;
+
+        uint8_t *pixel = &pixels[(y * width + x) * 3];
+        pixel[0] = r;
+        pixel[1] = g;
+        pixel[2] = bl;
+    }
+}
+
+void OffscreenRenderer::Draw(const TrackGeometry &geometry, int current_hinge)
+{
+    Clear();
+
+    for (int i = 1; i < geometry.path.size(); i++)
+        DrawLine(geometry.path[i - 1], geometry.path[i], 100, 100, 100);
+
+    for (int i = 1; i < geometry.bounds.size(); i++)
+    {
+        DrawLine(geometry.bounds[i - 1].first, geometry.bounds[i].first, 160,
+                 0, 0);
+        DrawLine(geometry.bounds[i - 1].second, geometry.bounds[i].second, 160,
+                 0, 0);
+    }
+
+    int count = geometry.hinges.size();
+    for (int i = 0; i < count; i++)
+        DrawLine(geometry.hinges[(i + count - 1) % count], geometry.hinges[i],
+                 0, geometry.speeds[i] * 200.0f + 50.0f, 0);
+
+    if (count > 0 && current_hinge >= 0)
+        DrawLine(geometry.hinges[current_hinge % count],
+                 geometry.hinges[(current_hinge + 1) % count], 255, 255, 255);
+}
+
+// === PNG ===
+
+static uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0)
+{
+    static uint32_t table[256];
+
+    if (table[1] == 0)
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+class BitWriter
+{
+    std::vector<uint8_t> &out;
+    uint32_t acc = 0;
+    int bits = 0;
+
+  public:
+    BitWriter(std::vector<uint8_t> &out) : out(out) {}
+
+    void Put(uint32_t value, int count)
+    {
+        acc |= value << bits;
+        bits += count;
+
+        for (; bits >= 8; bits -= 8, acc >>= 8)
+            out.push_back(acc & 0xFF);
+    }
+
+    // Huffman codes go out most significant bit first.
+    void PutCode(uint32_t code, int count)
+    {
+        uint32_t reversed = 0;
+        for (int i = 0; i < count; i++)
+            reversed |= ((code >> i) & 1) << (count - 1 - i);
+
+        Put(reversed, count);
+    }
+
+    void Symbol(int symbol)
+    {
+        if (symbol < 144)
+            PutCode(0x30 + symbol, 8);
+        else if (symbol < 256)
+            PutCode(0x190 + symbol - 144, 9);
+        else if (symbol < 280)
+            PutCode(symbol - 256, 7);
+        else
+            PutCode(0xC0 + symbol - 280, 8);
+    }
+
+    void Flush()
+    {
+        if (bits > 0)
+            out.push_back(acc & 0xFF);
+        acc = 0;
+        bits = 0;
+    }
+};
+
+// zlib stream of one fixed Huffman block. The only matches looked for are
+// runs of the previous byte, which after the Sub filter is what a mostly
+// black framebuffer turns into.
+static std::vector<uint8_t> deflate_runs(const std::vector<uint8_t> &data)
+{
+    static const int length_base[] = {3,  4,  5,  6,   7,   8,   9,   10,
+                                      11, 13, 15, 17,  19,  23,  27,  31,
+                                      35, 43, 51, 59,  67,  83,  99,  115,
+                                      131, 163, 195, 227, 258};
+    static const int length_extra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                       1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                       4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+    std::vector<uint8_t> out = {0x78, 0x01};
+    BitWriter bits(out);
+    uint32_t a = 1, b = 0;
+
+    bits.Put(1, 1);
+    bits.Put(1, 2);
+
+    for (size_t i = 0; i < data.size();)
+    {
+        size_t run = 0;
+        while (i > 0 && i + run < data.size() && run < 258 &&
+               data[i + run] == data[i - 1])
+            run++;
+
+        if (run >= 3)
+        {
+            int code = 28;
+            while ((size_t)length_base[code] > run)
+                code--;
+
+            bits.Symbol(257 + code);
+            bits.Put(run - length_base[code], length_extra[code]);
+            bits.PutCode(0, 5); // distance 1
+        }
+        else
+        {
+            run = 1;
+            bits.Symbol(data[i]);
+        }
+
+        for (size_t j = i; j < i + run; j++)
+        {
+            a = (a + data[j]) % 65521;
+            b = (b + a) % 65521;
+        }
+        i += run;
+    }
+
+    bits.Symbol(256);
+    bits.Flush();
+
+    uint32_t adler = (b << 16) | a;
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back(adler >> shift);
+
+    return out;
+}
+
+static void put_chunk(std::ofstream &file, const char *type,
+                      const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> chunk(type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+
+    uint32_t size = data.size(), crc = crc32(chunk.data(), chunk.size());
+    uint8_t size_be[4] = {(uint8_t)(size >> 24), (uint8_t)(size >> 16),
+                          (uint8_t)(size >> 8), (uint8_t)size};
+    uint8_t crc_be[4] = {(uint8_t)(crc >> 24), (uint8_t)(crc >> 16),
+                         (uint8_t)(crc >> 8), (uint8_t)crc};
+
+    file.write((char *)size_be, 4);
+    file.write((char *)chunk.data(), chunk.size());
+    file.write((char *)crc_be, 4);
+}
+
+bool OffscreenRenderer::WritePng(std::string filename)
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file)
+        return false;
+
+    const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    file.write((char *)signature, sizeof(signature));
+
+    std::vector<uint8_t> header = {
+        (uint8_t)(width >> 24),  (uint8_t)(width >> 16),
+        (uint8_t)(width >> 8),   (uint8_t)width,
+        (uint8_t)(height >> 24), (uint8_t)(height >> 16),
+        (uint8_t)(height >> 8),  (uint8_t)height,
+        8,                       2, // 8 bit RGB
+        0,                       0,
+        0};
+    put_chunk(file, "IHDR", header);
+
+    // Every scanline with the Sub filter: each byte minus the one a pixel
+    // to its left.
+    std::vector<uint8_t> filtered;
+    filtered.reserve(height * (width * 3 + 1));
+
+    for (int y = 0; y < height; y++)
+    {
+        const uint8_t *row = &pixels[y * width * 3];
+
+        filtered.push_back(1);
+        for (int x = 0; x < width * 3; x++)
+            filtered.push_back(row[x] - (x >= 3 ? row[x - 3] : 0));
+    }
+
+    put_chunk(file, "IDAT", deflate_runs(filtered));
+    put_chunk(file, "IEND", {});
+
+    return bool(file);
+}
+
+// === Writer thread ===
+
+TrackSnapshots::TrackSnapshots(std::string directory, int width, int height)
+    : directory(directory), renderer(width, height)
+{
+    mkdir(directory.c_str(), 0755);
+    writer = std::thread(&TrackSnapshots::WriterLoop, this);
+}
+
+TrackSnapshots::~TrackSnapshots()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+
+    wakeup.notify_one();
+    writer.join();
+
+    if (dropped > 0)
+        log_info("Dropped " + std::to_string(dropped) +
+                 " snapshot(s), the writer couldn't keep up");
+}
+
+void TrackSnapshots::Queue(std::shared_ptr<const TrackGeometry> geometry,
+                           int current_hinge, const std::string &name,
+                           int index)
+{
+    char filename[32];
+    snprintf(filename, sizeof(filename), "_%08d.png", index);
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        if (jobs.size() >= SNAPSHOT_QUEUE_LIMIT)
+        {
+            dropped++;
+            return;
+        }
+
+        jobs.push_back({geometry, current_hinge,
+                        directory + "/" + name + filename});
+    }
+
+    wakeup.notify_one();
+}
+
+void TrackSnapshots::WriterLoop()
+{
+    std::shared_ptr<const TrackGeometry> fitted;
+
+    while (true)
+    {
+        Job job;
+
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wakeup.wait(guard, [this]() { return stop || !jobs.empty(); });
+
+            // Whatever was queued before stopping still gets written.
+            if (jobs.empty())
+                return;
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        if (job.geometry != fitted)
+        {
+            renderer.Fit(*job.geometry);
+            fitted = job.geometry;
+        }
+
+        renderer.Draw(*job.geometry, job.current_hinge);
+        if (!renderer.WritePng(job.filename))
+            log_warning("Couldn't write " + job.filename + "!");
+    }
+}
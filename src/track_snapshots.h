@@ -0,0 +1,76 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hingy_math.h"
+
+// What the offscreen renderer draws, in track coordinates. Immutable once
+// built, so queued snapshots can share it.
+struct TrackGeometry
+{
+    std::vector<Vector2D> path;
+    std::vector<std::pair<Vector2D, Vector2D>> bounds;
+    std::vector<Vector2D> hinges;
+    std::vector<float> speeds;
+};
+
+// Software rasteriser into an RGB framebuffer, with a PNG writer that needs
+// nothing but the standard library (fixed Huffman deflate, run matches only).
+class OffscreenRenderer
+{
+    int width, height;
+    std::vector<uint8_t> pixels;
+
+    float scale = 1.0f, offset_x = 0.0f, offset_y = 0.0f;
+
+  public:
+    OffscreenRenderer(int width, int height);
+
+    // Maps the given geometry's bounding box onto the framebuffer.
+    void Fit(const TrackGeometry &geometry);
+
+    void Clear();
+    void DrawLine(Vector2D a, Vector2D b, uint8_t r, uint8_t g, uint8_t bl);
+    void Draw(const TrackGeometry &geometry, int current_hinge);
+
+    bool WritePng(std::string filename);
+};
+
+// Renders and writes snapshots on a background thread. Queueing one costs the
+// caller a shared_ptr copy and a short lock; if the writer falls behind,
+// snapshots are dropped rather than making the caller wait.
+class TrackSnapshots
+{
+    struct Job
+    {
+        std::shared_ptr<const TrackGeometry> geometry;
+        int current_hinge;
+        std::string filename;
+    };
+
+    std::string directory;
+    OffscreenRenderer renderer;
+
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::deque<Job> jobs;
+    bool stop = false;
+    int dropped = 0;
+    std::thread writer;
+
+    void WriterLoop();
+
+  public:
+    TrackSnapshots(std::string directory, int width, int height);
+    ~TrackSnapshots();
+
+    void Queue(std::shared_ptr<const TrackGeometry> geometry,
+               int current_hinge, const std::string &name, int index);
+};
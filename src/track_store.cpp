@@ -0,0 +1,230 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hingy_track.h"
+#include "track_store.h"
+#include "utils.h"
+
+using std::string;
+
+string TrackStore::Key(stringmap params)
+{
+    FILE *f = fopen(params["track"].c_str(), "rb");
+    if (f == NULL)
+        return "";
+
+    std::vector<char> contents(file_size(params["track"]));
+    size_t read = fread(contents.data(), 1, contents.size(), f);
+    fclose(f);
+
+    if (read != contents.size())
+        return "";
+
+    uint64_t hash = fnv1a(contents.data(), contents.size());
+    int constants[] = {TRACK_STORE_VERSION, HINGE_SKIP, HINGE_SETTLE_WINDOW,
+                       HINGE_PATCH_MARGIN,
+                       std::stoi(params["hinges_iterations"])};
+    float hold = HINGE_PATCH_HOLD;
+    hash = fnv1a(constants, sizeof(constants), hash);
+    hash = fnv1a(&hold, sizeof(hold), hash);
+
+    // Parsed, so "0.5" and "0.50" share a segment.
+    for (auto name :
+         {"force1", "force2", "hinges_tolerance", "sa", "sb", "sc"})
+    {
+        float value = std::stof(params[name]);
+        hash = fnv1a(&value, sizeof(value), hash);
+    }
+
+    char key[32];
+    snprintf(key, sizeof(key), "/hingy_%016llx", (unsigned long long)hash);
+    return key;
+}
+
+string TrackStore::ArtifactName(const string &key)
+{
+    return key.substr(1) + ".hprep";
+}
+
+// Whether the segment can never be attached: left unfinished by a
+// publisher that's gone, or from another version.
+static bool abandoned(int fd)
+{
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) != 0)
+        return false;
+
+    bool old = time(NULL) - stat_buf.st_ctime > TRACK_STORE_ABANDONED_S;
+    if (stat_buf.st_size < (off_t)sizeof(TrackStoreHeader))
+        return old;
+
+    void *image =
+        mmap(NULL, sizeof(TrackStoreHeader), PROT_READ, MAP_SHARED, fd, 0);
+    if (image == MAP_FAILED)
+        return false;
+
+    auto header = (const TrackStoreHeader *)image;
+    bool result;
+
+    if (header->ready.load(std::memory_order_acquire) == 1)
+        result = header->magic != TRACK_STORE_MAGIC ||
+                 header->version != TRACK_STORE_VERSION;
+    else if (header->publisher == 0)
+        result = old;
+    else
+        result = kill(header->publisher, 0) != 0 && errno == ESRCH;
+
+    munmap(image, sizeof(TrackStoreHeader));
+    return result;
+}
+
+// Removes the segment under the key if it's abandoned, true when the key is
+// free now. Takers hold a lock on the old segment and check the key still
+// names it, so two of them can't both remove one and then the other's new
+// segment.
+static bool reclaim(const string &key)
+{
+    int fd = shm_open(key.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return errno == ENOENT;
+
+    struct stat segment, named;
+    bool reclaimed =
+        flock(fd, LOCK_EX) == 0 && fstat(fd, &segment) == 0 &&
+        stat((TRACK_STORE_DIR + key).c_str(), &named) == 0 &&
+        named.st_dev == segment.st_dev && named.st_ino == segment.st_ino &&
+        abandoned(fd) && shm_unlink(key.c_str()) == 0;
+
+    close(fd);
+    return reclaimed;
+}
+
+TrackStoreHeader *TrackStore::Create(const string &key, size_t bytes)
+{
+    int fd = shm_open(key.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST && reclaim(key))
+    {
+        log_info("Took over the abandoned shared track " + key);
+        fd = shm_open(key.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+    if (fd < 0)
+        return NULL;
+
+    void *segment = MAP_FAILED;
+    if (ftruncate(fd, bytes) == 0)
+        segment =
+            mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (segment == MAP_FAILED)
+    {
+        shm_unlink(key.c_str());
+        return NULL;
+    }
+
+    // ftruncate zero fills, ready included.
+    auto header = (TrackStoreHeader *)segment;
+    header->publisher = getpid();
+    return header;
+}
+
+void TrackStore::Seal(TrackStoreHeader *header)
+{
+    header->magic = TRACK_STORE_MAGIC;
+    header->version = TRACK_STORE_VERSION;
+    header->ready.store(1, std::memory_order_release);
+
+    munmap(header, header->bytes);
+}
+
+std::shared_ptr<const TrackStoreHeader> TrackStore::Map(int fd)
+{
+    struct stat stat_buf;
+    size_t bytes = 0;
+    void *image = MAP_FAILED;
+
+    if (fstat(fd, &stat_buf) == 0 &&
+        stat_buf.st_size >= (off_t)sizeof(TrackStoreHeader))
+    {
+        bytes = stat_buf.st_size;
+        image = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (image == MAP_FAILED)
+        return nullptr;
+
+    std::shared_ptr<const TrackStoreHeader> header(
+        (const TrackStoreHeader *)image,
+        [bytes](const TrackStoreHeader *header) {
+            munmap((void *)header, bytes);
+        });
+
+    // Still being written, left behind by a publisher that died or from
+    // another version.
+    if (header->ready.load(std::memory_order_acquire) != 1 ||
+        header->magic != TRACK_STORE_MAGIC ||
+        header->version != TRACK_STORE_VERSION || header->bytes > bytes)
+        return nullptr;
+
+    return header;
+}
+
+std::shared_ptr<const TrackStoreHeader> TrackStore::Attach(const string &key)
+{
+    int fd = shm_open(key.c_str(), O_RDONLY, 0);
+    return fd < 0 ? nullptr : Map(fd);
+}
+
+int TrackStore::Purge()
+{
+    int removed = 0;
+    string prefix = string(TRACK_STORE_DIR) + "/hingy_";
+
+    for (auto &file : list_files(TRACK_STORE_DIR, ""))
+        if (file.compare(0, prefix.size(), prefix) == 0 &&
+            shm_unlink(file.substr(strlen(TRACK_STORE_DIR)).c_str()) == 0)
+            removed++;
+
+    return removed;
+}
+
+bool TrackStore::Save(const string &filename, TrackStoreHeader *header)
+{
+    header->publisher = 0;
+    header->magic = TRACK_STORE_MAGIC;
+    header->version = TRACK_STORE_VERSION;
+    header->ready.store(1);
+
+    // Written next to it and renamed, readers never see half a file.
+    string tmp = filename + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (f == NULL)
+        return false;
+
+    bool written = fwrite(header, 1, header->bytes, f) == header->bytes;
+    written = fclose(f) == 0 && written;
+
+    if (!written || rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        remove(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+std::shared_ptr<const TrackStoreHeader> TrackStore::Load(const string &filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    return fd < 0 ? nullptr : Map(fd);
+}
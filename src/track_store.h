@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "main.h"
+
+#define TRACK_STORE_MAGIC 0x4d485348 // "HSHM"
+#define TRACK_STORE_VERSION 3
+#define TRACK_STORE_DIR "/dev/shm"
+// A segment that's still empty this long after it was made lost its
+// publisher before it could say who it was.
+#define TRACK_STORE_ABANDONED_S 10
+
+// Start of a track image, in a segment or a .hprep file. The arrays follow
+// at the given offsets, bytes covers all of it. Readers only trust an image
+// once ready is set.
+struct TrackStoreHeader
+{
+    uint32_t magic, version;
+    std::atomic<uint32_t> ready;
+    // Process writing the segment, 0 in a file.
+    int32_t publisher;
+    uint32_t waypoint_size, bound_size, hinge_size;
+    uint64_t bytes;
+    uint64_t waypoints, bounds, hinges;
+    uint64_t waypoints_offset, bounds_offset, hinges_offset;
+    float hinge_sep;
+    float speed_params[3];
+};
+
+// Preprocessed tracks in named POSIX shared memory, one segment per hash of
+// the track file and the parameters that shaped it. The first process to
+// build a track publishes it, later ones map it read-only instead of loading
+// and relaxing a copy of their own. Segments outlive the processes, until a
+// reboot or Purge() (hingy_prep purge:1). One left unfinished by a publisher
+// that died is taken over by the next. The same images saved to disk are the
+// artifacts hingy_prep writes. Those are relaxed by HingeBatch, which isn't
+// bit-identical to a cold solve, so an artifact and a segment a bot built
+// itself under one key can differ in the last bits.
+class TrackStore
+{
+    static std::shared_ptr<const TrackStoreHeader> Map(int fd);
+
+  public:
+    // Segment name for the track, the parameters and the constants that
+    // shape the result, "" if the track can't be read.
+    static std::string Key(stringmap params);
+    // File name of the artifact for a key.
+    static std::string ArtifactName(const std::string &key);
+
+    // A zeroed, writable segment of the given size, NULL when another
+    // process is publishing or published it or it can't be made. Replaces
+    // one that can never be attached.
+    static TrackStoreHeader *Create(const std::string &key, size_t bytes);
+    // Marks a created segment complete and unmaps it.
+    static void Seal(TrackStoreHeader *header);
+    // Maps a complete segment read-only, null when there's none.
+    static std::shared_ptr<const TrackStoreHeader>
+    Attach(const std::string &key);
+    // Removes every segment, returns how many. Processes that have one
+    // mapped keep it.
+    static int Purge();
+
+    // Writes a complete image to the file, atomically.
+    static bool Save(const std::string &filename, TrackStoreHeader *header);
+    // Maps an image saved by Save() read-only, null if it can't be used.
+    static std::shared_ptr<const TrackStoreHeader>
+    Load(const std::string &filename);
+};
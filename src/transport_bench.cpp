@@ -0,0 +1,142 @@
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "batched_integration.h"
+#include "logger.h"
+#include "main.h"
+#include "standin_server.h"
+#include "torcs_integration.h"
+#include "utils.h"
+
+using std::string;
+using namespace std::chrono;
+
+// Measures syscalls per tick and round trip latency of the simulator
+// transports against an in-process stand-in server.
+
+const std::vector<std::pair<string, string>> default_params = {
+    {"integration", "batched"},
+    {"cars", "4"},
+    {"ticks", "20000"},
+    {"timeout_us", "10000"},
+    {"host", "127.0.0.1"},
+    {"port", "3101"},
+    {"server_port", "3001"},
+    {"handshake_retry_us", "100"},
+    {"handshake_retry_max_us", "50000"},
+    {"handshake_timeout_ms", "5000"}};
+
+int main(int argc, char **argv)
+{
+    stringmap params;
+    parse_arguments("", ':', argc - 1, &argv[1], params);
+
+    for (auto &param : default_params)
+        if (params.find(param.first) == params.end())
+            params[param.first] = param.second;
+
+    int cars = std::stoi(params["cars"]);
+    int ticks = std::stoi(params["ticks"]);
+    int timeout_us = std::stoi(params["timeout_us"]);
+    bool batched = params["integration"] == "batched";
+
+    if (!batched && cars != 1)
+        log_error("integration:torcs talks to a single car!");
+
+    StandinServer server(std::stoi(params["server_port"]), cars);
+
+    std::thread server_thread([&]() {
+        std::vector<CarState> states(cars);
+        std::vector<string> messages(cars);
+
+        for (auto &state : states)
+            state.sensors.fill(200.0f);
+
+        server.AwaitClients();
+
+        // The first state waits out the client's handshake, the last one is
+        // never answered since the client stops collecting.
+        for (int t = 0; t <= ticks; t++)
+        {
+            for (int i = 0; i < cars; i++)
+            {
+                states[i].absolute_odometer += 0.22f;
+                states[i].current_lap_time += 0.02f;
+                messages[i] = StandinServer::EncodeCarState(states[i]);
+            }
+
+            server.Tick(messages, t == 0 ? 5000000 : timeout_us, t < ticks);
+            if (t == 0)
+                server.ResetStats();
+        }
+    });
+
+    std::shared_ptr<BatchedUdpTransport> transport;
+    std::unique_ptr<TorcsIntegration> single;
+    std::vector<SimIntegration *> integrations;
+    std::vector<std::unique_ptr<SimIntegration>> owned;
+
+    if (batched)
+    {
+        transport = std::make_shared<BatchedUdpTransport>(params, cars);
+        for (int i = 0; i < cars; i++)
+        {
+            owned.emplace_back(new BatchedTorcsIntegration(transport, i));
+            integrations.push_back(owned.back().get());
+        }
+    }
+    else
+    {
+        single = std::make_unique<TorcsIntegration>(params);
+        integrations.push_back(single.get());
+    }
+
+    stringmap init_params;
+    for (int i = -9; i <= 9; i++)
+        init_params["ds" + std::to_string(i)] = "0";
+
+    auto handshake_start = steady_clock::now();
+    for (auto integration : integrations)
+        integration->Begin(init_params);
+    auto handshake_us = duration_cast<microseconds>(steady_clock::now() -
+                                                    handshake_start)
+                            .count();
+
+    CarSteers steers;
+    auto start_time = steady_clock::now();
+
+    for (int t = 0; t < ticks; t++)
+    {
+        for (auto integration : integrations)
+            integration->Submit(steers);
+        for (auto integration : integrations)
+            integration->Collect();
+    }
+
+    auto seconds =
+        duration_cast<microseconds>(steady_clock::now() - start_time).count() /
+        1e6;
+    server_thread.join();
+
+    uint64_t receive_calls = batched ? transport->receive_calls
+                                     : single->receive_calls;
+    uint64_t send_calls = batched ? transport->send_calls : single->send_calls;
+    auto &rtt = server.RoundTrips();
+
+    // Whatever was logged goes out before the results.
+    Logger::Get().Flush();
+    printf("integration=%s cars=%d ticks=%d\n", params["integration"].c_str(),
+           cars, ticks);
+    printf("handshake_us=%ld ticks/s=%.1f\n", (long)handshake_us,
+           ticks / seconds);
+    printf("receive_syscalls/tick=%.3f send_syscalls/tick=%.3f\n",
+           (double)receive_calls / ticks, (double)send_calls / ticks);
+    printf("rtt_us p50=%.1f p99=%.1f p99.9=%.1f max=%.1f timeouts=%d\n",
+           StandinServer::Percentile(rtt, 0.5f),
+           StandinServer::Percentile(rtt, 0.99f),
+           StandinServer::Percentile(rtt, 0.999f),
+           StandinServer::Percentile(rtt, 1.0f), server.Timeouts());
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+
+// Single producer, single consumer hand-over of whole values without locks.
+// The producer fills its back slot and swaps it with the middle one, the
+// consumer swaps its front slot with the middle one whenever something new
+// was left there. Neither side ever waits for the other.
+template <typename T> class TripleBuffer
+{
+    static const int FRESH = 4;
+
+    T slots[3];
+    std::atomic<int> middle{1};
+    int back = 0, front = 2;
+
+  public:
+    // Producer side.
+    T &Back() { return slots[back]; }
+
+    void Publish() { back = middle.exchange(back | FRESH) & ~FRESH; }
+
+    // True while the last published value hasn't been picked up yet.
+    bool Pending() { return middle.load() & FRESH; }
+
+    // Consumer side, returns whether the front slot changed.
+    bool Update()
+    {
+        if (!(middle.load() & FRESH))
+            return false;
+
+        front = middle.exchange(front) & ~FRESH;
+        return true;
+    }
+
+    const T &Front() { return slots[front]; }
+};
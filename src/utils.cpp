@@ -1,11 +1,14 @@
 
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 
 #ifndef _WIN64
+#include <dirent.h>
 #include <sys/stat.h>
 #endif
 
+#include "logger.h"
 #include "utils.h"
 
 #include "rapidxml/rapidxml.hpp"
@@ -14,6 +17,8 @@
 using std::string;
 using namespace rapidxml;
 
+bool crash_on_warning;
+
 bool parse_arguments(string name_prefix, char name_value_sep, int argc,
                      char **argv, stringmap &out)
 {
@@ -108,6 +113,25 @@ bool load_params_from_xml(string filename, string main_node_name,
     return false;
 }
 
+bool save_params_to_xml(string filename, string main_node_name,
+                        const stringmap &params)
+{
+    xml_document<> doc;
+    auto main_node = doc.allocate_node(node_element, main_node_name.c_str());
+    doc.append_node(main_node);
+
+    for (auto &param : params)
+        main_node->append_node(doc.allocate_node(
+            node_element, param.first.c_str(), param.second.c_str()));
+
+    std::ofstream file(filename);
+    if (!file)
+        return false;
+
+    file << doc;
+    return bool(file);
+}
+
 bool file_exists(string name)
 {
     FILE *f = fopen(name.c_str(), "rb");
@@ -127,3 +151,72 @@ size_t file_size(std::string name)
     int rc = stat(name.c_str(), &stat_buf);
     return rc == 0 ? stat_buf.st_size : -1;
 }
+
+uint64_t fnv1a(const void *data, size_t size, uint64_t hash)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+
+    return hash;
+}
+
+bool has_suffix(const string &name, const string &suffix)
+{
+    return name.size() >= suffix.size() &&
+           name.compare(name.size() - suffix.size(), suffix.size(), suffix) ==
+               0;
+}
+
+std::vector<string> list_files(string dir, string suffix)
+{
+    std::vector<string> files;
+    DIR *d = opendir(dir.c_str());
+
+    if (d == NULL)
+        return files;
+
+    while (dirent *entry = readdir(d))
+    {
+        string name = entry->d_name;
+        if (has_suffix(name, suffix))
+            files.push_back(dir + "/" + name);
+    }
+
+    closedir(d);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Messages longer than a record holds go out in pieces, the ones after the
+// first marked as continuing it.
+template <LogLevel level> static void log_message(const std::string &msg)
+{
+    if (msg.size() <= LOG_MAX_STRING)
+    {
+        HLOG(level, "%s", msg);
+        return;
+    }
+
+    HLOG(level, "%s", msg.substr(0, LOG_MAX_STRING));
+    for (size_t at = LOG_MAX_STRING; at < msg.size(); at += LOG_MAX_STRING)
+        HLOG(level, "... %s", msg.substr(at, LOG_MAX_STRING));
+}
+
+void log_error(const std::string &msg)
+{
+    // Nothing queued may be lost, and the error has to be out before exit.
+    log_message<LEVEL_ERROR>(msg);
+    Logger::Get().Flush();
+    exit(1);
+}
+
+void log_warning(const std::string &msg)
+{
+    log_message<LEVEL_WARNING>(msg);
+    if (crash_on_warning)
+        log_error("Paranoid crash on warning!");
+}
+
+void log_info(const std::string &msg) { log_message<LEVEL_INFO>(msg); }
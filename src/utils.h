@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <map>
 #include <string>
 #include <vector>
@@ -11,5 +12,15 @@ bool parse_arguments(std::string name_prefix, char name_value_sep, int argc,
 bool load_params_from_xml(std::string filename, std::string main_node,
                           stringmap &out);
 
+bool save_params_to_xml(std::string filename, std::string main_node,
+                        const stringmap &params);
+
 bool file_exists(std::string name);
-size_t file_size(std::string name);
\ No newline at end of file
+bool has_suffix(const std::string &name, const std::string &suffix);
+size_t file_size(std::string name);
+// FNV-1a, chained through hash.
+uint64_t fnv1a(const void *data, size_t size,
+               uint64_t hash = 0xcbf29ce484222325ull);
+
+// Files in dir whose names end with suffix, as dir/name, sorted.
+std::vector<std::string> list_files(std::string dir, std::string suffix);
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cmath>
+
+#include "waypoint_simplifier.h"
+
+static float wrap(float angle) { return std::remainder(angle, 2.0f * M_PI); }
+
+WaypointSimplifier::WaypointSimplifier(float tolerance, float forward_factor,
+                                       float angle_factor)
+    : tolerance(tolerance), forward_factor(forward_factor),
+      angle_factor(angle_factor)
+{
+}
+
+void WaypointSimplifier::Emit(float next_heading, std::vector<Waypoint> &out)
+{
+    if (!has_pending)
+        return;
+
+    pending.a = wrap(next_heading - pending_heading) / angle_factor;
+    out.push_back(pending);
+    has_pending = false;
+}
+
+void WaypointSimplifier::Close(std::vector<Waypoint> &out)
+{
+    float chord = std::atan2(end_y - anchor_y, end_x - anchor_x);
+    Emit(chord, out);
+
+    pending = Waypoint{run.f, 0.0f, run.l / run_count, run.r / run_count};
+    pending_heading = chord;
+    has_pending = true;
+
+    anchor_x = end_x;
+    anchor_y = end_y;
+    run_count = 0;
+}
+
+void WaypointSimplifier::Add(const Waypoint &waypoint,
+                             std::vector<Waypoint> &out)
+{
+    if (tolerance <= 0.0f)
+    {
+        out.push_back(waypoint);
+        return;
+    }
+
+    float px = x + std::cos(heading) * forward_factor * waypoint.f;
+    float py = y + std::sin(heading) * forward_factor * waypoint.f;
+
+    if (!has_pending && run_count == 0)
+    {
+        // The first one sets the direction the path starts in, kept as is.
+        pending = waypoint;
+        pending_heading = heading;
+        has_pending = true;
+        anchor_x = px;
+        anchor_y = py;
+    }
+    else
+    {
+        // Directions are taken from the heading the run started in.
+        if (run_count == 0)
+            reference = heading;
+
+        float distance = std::hypot(px - anchor_x, py - anchor_y);
+        float direction =
+            wrap(std::atan2(py - anchor_y, px - anchor_x) - reference);
+
+        if (run_count > 0 &&
+            (run.f + waypoint.f > SIMPLIFY_MAX_RUN ||
+             (distance > tolerance && (direction < low || direction > high))))
+        {
+            Close(out);
+
+            reference = heading;
+            distance = std::hypot(px - anchor_x, py - anchor_y);
+            direction =
+                wrap(std::atan2(py - anchor_y, px - anchor_x) - reference);
+        }
+
+        if (run_count == 0)
+        {
+            run = Waypoint{0.0f, 0.0f, 0.0f, 0.0f};
+            low = -M_PI;
+            high = M_PI;
+        }
+
+        run.f += waypoint.f;
+        run.l += waypoint.l;
+        run.r += waypoint.r;
+        run_count++;
+
+        // Narrows to the directions passing within tolerance of this point.
+        if (distance > tolerance)
+        {
+            float spread = std::asin(tolerance / distance);
+            low = std::max(low, direction - spread);
+            high = std::min(high, direction + spread);
+        }
+
+        end_x = px;
+        end_y = py;
+    }
+
+    x = px;
+    y = py;
+    heading += waypoint.a * angle_factor;
+}
+
+void WaypointSimplifier::Flush(std::vector<Waypoint> &out)
+{
+    if (run_count > 0)
+        Close(out);
+
+    Emit(heading, out);
+
+    x = y = heading = 0.0f;
+    anchor_x = anchor_y = end_x = end_y = 0.0f;
+    run_count = 0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+
+#include "hingy_track.h"
+
+// Longest stretch, in odometer units, one simplified waypoint may cover.
+// Hinges sit on waypoints every 13 units, so this keeps them close to that.
+#define SIMPLIFY_MAX_RUN 2.5f
+
+// Merges recorded waypoints online into fewer, longer ones. A run of them
+// becomes one waypoint along the chord from its start to its end, as long as
+// every point of the run is within tolerance of that chord, in the units of
+// ConstructBounds. The test is a sleeve of the directions from the start
+// that pass close enough to each point so far, so every waypoint costs the
+// same however long the run gets. A merged waypoint keeps the odometer
+// length of the run, the turns between chords are set once the next chord
+// is known. A tolerance of 0 passes the waypoints through.
+class WaypointSimplifier
+{
+    using Waypoint = HingyTrack::Waypoint;
+
+    float tolerance, forward_factor, angle_factor;
+
+    // The recorded path, integrated as ConstructBounds does.
+    float x = 0.0f, y = 0.0f, heading = 0.0f;
+
+    // The run in progress, from the anchor to the last point taken in.
+    float anchor_x = 0.0f, anchor_y = 0.0f;
+    float end_x = 0.0f, end_y = 0.0f;
+    float reference, low, high;
+    Waypoint run;
+    int run_count = 0;
+
+    // The last finished waypoint, waiting for the chord after it to know its
+    // turn.
+    Waypoint pending;
+    float pending_heading = 0.0f;
+    bool has_pending = false;
+
+    void Close(std::vector<Waypoint> &out);
+    void Emit(float next_heading, std::vector<Waypoint> &out);
+
+  public:
+    WaypointSimplifier(float tolerance, float forward_factor,
+                       float angle_factor);
+
+    void Add(const Waypoint &waypoint, std::vector<Waypoint> &out);
+    // Writes out everything held back, ends the path.
+    void Flush(std::vector<Waypoint> &out);
+};
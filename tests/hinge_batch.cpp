@@ -0,0 +1,87 @@
+#define BOOST_TEST_MODULE hinge_batch
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <cmath>
+#include <unistd.h>
+
+#include "hinge_batch.h"
+
+using Waypoint = HingyTrack::Waypoint;
+
+#define ITERATIONS 500
+// Largest distance a lane's hinge may end up from SimulateHinges' one. The
+// two take different routes to the same directions, so they differ in the
+// last bits while the hinges move, by up to about 6e-5 here, and agree again
+// as the ring settles.
+#define TOLERANCE 1e-4f
+
+// One lap of a ring with tighter and looser corners, about fifty
+// hinges.
+static HingyTrack small_ring()
+{
+    std::vector<Waypoint> lap;
+    const int count = 3000;
+    const float turn = 2 * M_PI / (count * 0.1965f);
+
+    for (int i = 0; i < count; i++)
+    {
+        float l = 0.02f * std::sin(i / 100.0f);
+        lap.push_back(Waypoint{0.22f,
+                               turn * (1.0f + 0.8f * std::sin(i * 6 * M_PI /
+                                                              count)),
+                               l, -l});
+    }
+
+    std::string filename =
+        "/tmp/hinge_batch_test_" + std::to_string(getpid()) + ".xml";
+    BOOST_REQUIRE(HingyTrack::SaveWaypoints(filename, lap));
+
+    HingyTrack track(filename);
+    remove(filename.c_str());
+
+    track.ConstructBounds();
+    track.ConstructHinges(HINGE_SKIP);
+    return track;
+}
+
+BOOST_AUTO_TEST_CASE(lanes_match_simulate_hinges)
+{
+    HingyTrack ring = small_ring();
+    // From barely moving the hinges to pressing most against the bounds.
+    std::vector<std::pair<float, float>> forces = {
+        {0.1f, 0.001f}, {0.3f, 0.003f},  {1.0f, 0.01f},
+        {0.5f, 0.02f},  {2.0f, 0.005f}, {0.0f, 0.01f}};
+
+    BOOST_REQUIRE_GT(ring.GetGeometry().hinges.size(), 40);
+
+    HingeBatch batch(ring, forces);
+    batch.Simulate(ITERATIONS);
+    BOOST_REQUIRE_EQUAL(batch.Lanes(), forces.size());
+
+    for (int lane = 0; lane < forces.size(); lane++)
+    {
+        HingyTrack alone(ring), batched(ring);
+
+        for (int i = 0; i < ITERATIONS; i++)
+            alone.SimulateHinges(forces[lane].first, forces[lane].second);
+        batch.Store(lane, batched);
+
+        auto expected = alone.GetGeometry().hinges;
+        auto got = batched.GetGeometry().hinges;
+        auto start = ring.GetGeometry().hinges;
+        float worst = 0.0f, moved = 0.0f;
+
+        BOOST_REQUIRE_EQUAL(got.size(), expected.size());
+        for (size_t i = 0; i < got.size(); i++)
+        {
+            worst = std::max(worst, (got[i] - expected[i]).Length());
+            moved += (expected[i] - start[i]).Length() / got.size();
+        }
+
+        BOOST_TEST_MESSAGE("Lane " << lane << ": moved on average " << moved
+                                   << ", off by up to " << worst);
+        BOOST_CHECK_GT(moved, 0.1f);
+        BOOST_CHECK_LE(worst, TOLERANCE);
+    }
+}
@@ -0,0 +1,110 @@
+#define BOOST_TEST_MODULE lap_fusion
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <cmath>
+#include <random>
+
+#include "lap_fusion.h"
+
+using Waypoint = HingyTrack::Waypoint;
+
+// A closed lap of gentle curves, 0.2 m per waypoint like a recording.
+static std::vector<Waypoint> true_lap()
+{
+    std::vector<Waypoint> lap;
+
+    for (int i = 0; i < 5000; i++)
+        lap.push_back(Waypoint{0.2f, 0.004f * std::sin(i / 300.0f) + 0.0005f,
+                               std::sin(i / 700.0f), -std::sin(i / 700.0f)});
+
+    return lap;
+}
+
+// The lap as the car records it: wheel slip on every turn, jitter in the
+// odometer and the track position, and now and then a glitch.
+static std::vector<Waypoint> noisy_lap(const std::vector<Waypoint> &lap,
+                                       std::mt19937 &rng)
+{
+    std::normal_distribution<float> turn(0.0f, 0.002f), forward(0.0f, 0.01f),
+        position(0.0f, 0.05f);
+    std::uniform_int_distribution<int> glitch(0, 200);
+    std::vector<Waypoint> noisy = lap;
+
+    for (auto &waypoint : noisy)
+    {
+        waypoint.f += forward(rng);
+        waypoint.a += turn(rng);
+        waypoint.l += position(rng);
+        waypoint.r = -waypoint.l;
+        if (glitch(rng) == 0)
+            waypoint.a += 0.05f;
+    }
+
+    return noisy;
+}
+
+// Rms distance between the dead-reckoned paths, waypoint by waypoint.
+static float path_error(const std::vector<Waypoint> &a,
+                        const std::vector<Waypoint> &b)
+{
+    float ax = 0, ay = 0, ah = 0, bx = 0, by = 0, bh = 0, sum = 0;
+
+    BOOST_REQUIRE_EQUAL(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        ax += std::cos(ah) * a[i].f;
+        ay += std::sin(ah) * a[i].f;
+        ah += a[i].a;
+        bx += std::cos(bh) * b[i].f;
+        by += std::sin(bh) * b[i].f;
+        bh += b[i].a;
+        sum += (ax - bx) * (ax - bx) + (ay - by) * (ay - by);
+    }
+
+    return std::sqrt(sum / a.size());
+}
+
+static float position_error(const std::vector<Waypoint> &a,
+                            const std::vector<Waypoint> &b)
+{
+    float sum = 0;
+
+    for (size_t i = 0; i < a.size(); i++)
+        sum += (a[i].l - b[i].l) * (a[i].l - b[i].l);
+
+    return std::sqrt(sum / a.size());
+}
+
+BOOST_AUTO_TEST_CASE(fused_laps_are_closer_to_the_truth_than_one)
+{
+    std::mt19937 rng(1);
+    auto truth = true_lap();
+    std::vector<std::vector<Waypoint>> laps;
+
+    for (int i = 0; i < 5; i++)
+        laps.push_back(noisy_lap(truth, rng));
+
+    auto fused = fuse_laps(laps, 2);
+
+    for (auto &lap : laps)
+    {
+        BOOST_CHECK_LT(path_error(fused, truth), path_error(lap, truth) / 2.0f);
+        BOOST_CHECK_LT(position_error(fused, truth),
+                       position_error(lap, truth) / 1.5f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(single_lap_comes_back_as_is)
+{
+    std::mt19937 rng(2);
+    auto lap = noisy_lap(true_lap(), rng);
+    auto fused = fuse_laps({lap});
+
+    BOOST_REQUIRE_EQUAL(fused.size(), lap.size());
+    for (size_t i = 0; i < lap.size(); i++)
+    {
+        BOOST_CHECK_EQUAL(fused[i].f, lap[i].f);
+        BOOST_CHECK_EQUAL(fused[i].a, lap[i].a);
+    }
+}
@@ -0,0 +1,87 @@
+#define BOOST_TEST_MODULE latency_stats
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "latency_stats.h"
+
+BOOST_AUTO_TEST_CASE(small_values_have_buckets_of_their_own)
+{
+    for (uint64_t ns = 0; ns < (1 << LATENCY_SUB_BITS); ns++)
+    {
+        BOOST_CHECK_EQUAL(LatencyHistogram::Bucket(ns), ns);
+        BOOST_CHECK_EQUAL(LatencyHistogram::BucketTop(ns), ns);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bucket_tops_are_the_edges)
+{
+    // Each bucket ends at its top and the next starts right after, so the
+    // buckets cover every value once and in order.
+    for (int bucket = 0; bucket < LATENCY_BUCKETS - 1; bucket++)
+    {
+        uint64_t top = LatencyHistogram::BucketTop(bucket);
+
+        BOOST_REQUIRE_EQUAL(LatencyHistogram::Bucket(top), bucket);
+        BOOST_REQUIRE_EQUAL(LatencyHistogram::Bucket(top + 1), bucket + 1);
+    }
+
+    BOOST_CHECK_EQUAL(LatencyHistogram::Bucket(UINT64_MAX),
+                      LATENCY_BUCKETS - 1);
+    BOOST_CHECK_EQUAL(LatencyHistogram::BucketTop(LATENCY_BUCKETS - 1),
+                      UINT64_MAX);
+}
+
+BOOST_AUTO_TEST_CASE(buckets_are_within_a_sixteenth)
+{
+    for (int bucket = 1; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        uint64_t bottom = LatencyHistogram::BucketTop(bucket - 1) + 1;
+        uint64_t top = LatencyHistogram::BucketTop(bucket);
+
+        BOOST_REQUIRE_LE(top - bottom, bottom >> LATENCY_SUB_BITS);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(percentiles_report_bucket_tops)
+{
+    std::vector<uint64_t> counts(LATENCY_BUCKETS, 0);
+
+    BOOST_CHECK_EQUAL(LatencyHistogram::Percentile(counts, 0.5), 0);
+
+    // 90 samples at 1 us, 10 at 1 ms.
+    counts[LatencyHistogram::Bucket(1000)] = 90;
+    counts[LatencyHistogram::Bucket(1000000)] = 10;
+
+    uint64_t low = LatencyHistogram::BucketTop(LatencyHistogram::Bucket(1000));
+    uint64_t high =
+        LatencyHistogram::BucketTop(LatencyHistogram::Bucket(1000000));
+
+    BOOST_CHECK_EQUAL(LatencyHistogram::Percentile(counts, 0.0), low);
+    BOOST_CHECK_EQUAL(LatencyHistogram::Percentile(counts, 0.5), low);
+    BOOST_CHECK_EQUAL(LatencyHistogram::Percentile(counts, 0.9), low);
+    BOOST_CHECK_EQUAL(LatencyHistogram::Percentile(counts, 0.91), high);
+    BOOST_CHECK_EQUAL(LatencyHistogram::Percentile(counts, 1.0), high);
+}
+
+BOOST_AUTO_TEST_CASE(histogram_counts_and_keeps_the_max)
+{
+    LatencyHistogram histogram;
+    std::vector<uint64_t> counts;
+    uint64_t max_ns;
+
+    histogram.Record(5);
+    histogram.Record(5);
+    histogram.Record(123456);
+    histogram.Read(counts, max_ns);
+
+    BOOST_CHECK_EQUAL(counts.size(), LATENCY_BUCKETS);
+    BOOST_CHECK_EQUAL(counts[5], 2);
+    BOOST_CHECK_EQUAL(counts[LatencyHistogram::Bucket(123456)], 1);
+    BOOST_CHECK_EQUAL(max_ns, 123456);
+
+    histogram.Clear();
+    histogram.Read(counts, max_ns);
+
+    BOOST_CHECK_EQUAL(counts[5], 0);
+    BOOST_CHECK_EQUAL(max_ns, 0);
+}
@@ -0,0 +1,147 @@
+#define BOOST_TEST_MODULE logger
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+
+#include <unistd.h>
+
+#include "logger.h"
+#include "utils.h"
+
+using std::string;
+
+// Encodes the arguments the way log_write() does, without the header.
+template <typename... Args> static std::string encode(const Args &... args)
+{
+    char record[LOG_MAX_RECORD];
+    char *cursor = record + 14;
+
+    log_encode_all(cursor, record + LOG_MAX_RECORD, args...);
+    return std::string(record + 14, cursor);
+}
+
+template <typename... Args>
+static std::string format(const std::string &format, const Args &... args)
+{
+    std::string encoded = encode(args...);
+    return Logger::FormatRecord(format, encoded.data(), encoded.size());
+}
+
+BOOST_AUTO_TEST_CASE(ring_keeps_records_in_order_across_the_wrap)
+{
+    LogRing ring;
+    char record[LOG_MAX_RECORD], out[LOG_MAX_RECORD];
+
+    // Sizes that don't divide the ring, so records straddle its end.
+    for (int i = 0; i < 3 * LOG_RING_SIZE / 300; i++)
+    {
+        uint16_t size = 300;
+        memcpy(record, &size, 2);
+        memset(record + 2, i, size - 2);
+
+        BOOST_REQUIRE(ring.Push(record, size));
+        BOOST_REQUIRE_EQUAL(ring.Peek(out, sizeof(out)), size);
+        BOOST_REQUIRE_EQUAL(memcmp(out, record, size), 0);
+        ring.Pop(size);
+        BOOST_REQUIRE(ring.Empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(full_ring_refuses_records)
+{
+    LogRing ring;
+    char record[LOG_MAX_RECORD] = {};
+    uint16_t size = LOG_MAX_RECORD;
+    memcpy(record, &size, 2);
+
+    for (int i = 0; i < LOG_RING_SIZE / LOG_MAX_RECORD; i++)
+        BOOST_REQUIRE(ring.Push(record, size));
+
+    BOOST_CHECK(!ring.Push(record, size));
+    ring.Pop(size);
+    BOOST_CHECK(ring.Push(record, size));
+}
+
+BOOST_AUTO_TEST_CASE(records_format_like_printf)
+{
+    BOOST_CHECK_EQUAL(format("%d and %u", -3, 7u), "-3 and 7");
+    BOOST_CHECK_EQUAL(format("%.2f", 1.005), "1.00");
+    BOOST_CHECK_EQUAL(format("%5.1f|%-4d|", 2.25f, 42), "  2.2|42  |");
+    BOOST_CHECK_EQUAL(format("%s/%s", std::string("a"), "b"), "a/b");
+    BOOST_CHECK_EQUAL(format("%lld %zu 100%%", (long long)1 << 40, (size_t)5),
+                      "1099511627776 5 100%");
+}
+
+BOOST_AUTO_TEST_CASE(records_missing_arguments_say_so)
+{
+    BOOST_CHECK_EQUAL(format("%d %d", 1), "1 <missing>");
+}
+
+BOOST_AUTO_TEST_CASE(long_strings_are_marked_truncated)
+{
+    std::string fits(LOG_MAX_STRING, 'x'), long_one(LOG_MAX_STRING + 10, 'y');
+
+    BOOST_CHECK_EQUAL(format("%s", fits), fits);
+
+    std::string cut = format("%s", long_one);
+    BOOST_CHECK_EQUAL(cut.size(), LOG_MAX_STRING);
+    BOOST_CHECK_EQUAL(cut.substr(cut.size() - strlen(LOG_TRUNCATED)),
+                      LOG_TRUNCATED);
+}
+
+BOOST_AUTO_TEST_CASE(binary_definitions_come_before_their_records)
+{
+    string filename = "/tmp/logger_test_" + std::to_string(getpid()) + ".hlog";
+    BOOST_REQUIRE(Logger::Get().OpenBinary(filename));
+
+    // Call sites showing up while the writer is draining.
+    std::atomic<bool> done{false};
+    std::thread logging([&]() {
+        for (int i = 0; i < 20000; i++)
+            log_write(Logger::Get().Register(LEVEL_INFO, "site %d"), i);
+        done = true;
+    });
+
+    while (!done)
+        Logger::Get().Flush();
+    logging.join();
+    Logger::Get().Flush();
+
+    FILE *f = fopen(filename.c_str(), "rb");
+    BOOST_REQUIRE(f != NULL);
+    std::vector<char> data(file_size(filename));
+    BOOST_REQUIRE_EQUAL(fread(data.data(), 1, data.size(), f), data.size());
+    fclose(f);
+    remove(filename.c_str());
+
+    std::set<uint32_t> defined;
+    // Past the "HLOG1\n" magic.
+    size_t records = 0, at = 6;
+    uint32_t id;
+    uint16_t size;
+
+    while (at < data.size())
+    {
+        char kind = data[at++];
+        memcpy(&id, &data[at], 4);
+
+        if (kind == 'D')
+        {
+            memcpy(&size, &data[at + 5], 2);
+            defined.insert(id);
+            at += 7 + size;
+        }
+        else
+        {
+            BOOST_REQUIRE_EQUAL(kind, 'R');
+            memcpy(&size, &data[at], 2);
+            memcpy(&id, &data[at + 2], 4);
+            BOOST_REQUIRE(defined.count(id));
+            records++;
+            at += size;
+        }
+    }
+
+    BOOST_CHECK_GT(records, 0);
+}
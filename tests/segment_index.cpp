@@ -0,0 +1,182 @@
+#define BOOST_TEST_MODULE segment_index
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+
+#include "segment_index.h"
+
+using Segment = std::pair<Vector2D, Vector2D>;
+
+// A wandering closed-ish polyline, like a track's hinges.
+static std::vector<Segment> polyline(std::mt19937 &rng, size_t count)
+{
+    std::normal_distribution<float> turn(0.0f, 0.3f);
+    std::uniform_real_distribution<float> step(0.5f, 3.0f);
+    std::vector<Segment> segments;
+    Vector2D point{0.0f, 0.0f};
+    float heading = 0.0f;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        heading += turn(rng);
+        Vector2D next{point.x + std::cos(heading) * step(rng),
+                      point.y + std::sin(heading) * step(rng)};
+        segments.push_back({point, next});
+        point = next;
+    }
+
+    return segments;
+}
+
+static float point_distance(Vector2D a, Vector2D b)
+{
+    return (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y);
+}
+
+static float segment_distance(const Segment &segment, Vector2D point)
+{
+    float ex = segment.second.x - segment.first.x;
+    float ey = segment.second.y - segment.first.y;
+    float length = ex * ex + ey * ey;
+    float t = length > 0.0f ? ((point.x - segment.first.x) * ex +
+                               (point.y - segment.first.y) * ey) /
+                                  length
+                            : 0.0f;
+    t = std::min(std::max(t, 0.0f), 1.0f);
+
+    return point_distance(
+        Vector2D{segment.first.x + t * ex, segment.first.y + t * ey}, point);
+}
+
+// Proper crossings only, the index may also report touching ones.
+static bool crosses(const Segment &segment, Vector2D a, Vector2D b)
+{
+    auto side = [](Vector2D p, Vector2D q, Vector2D point) {
+        return (q.x - p.x) * (point.y - p.y) - (q.y - p.y) * (point.x - p.x);
+    };
+
+    return side(a, b, segment.first) * side(a, b, segment.second) < 0.0f &&
+           side(segment.first, segment.second, a) *
+                   side(segment.first, segment.second, b) <
+               0.0f;
+}
+
+// Ties between equally near segments can go either way, so the distances
+// are compared rather than the indices.
+static void check_against_brute_force(const SegmentIndex &index,
+                                      const std::vector<Segment> &segments,
+                                      std::mt19937 &rng)
+{
+    float lx = FLT_MAX, ly = FLT_MAX, hx = -FLT_MAX, hy = -FLT_MAX;
+    for (auto &segment : segments)
+    {
+        lx = std::min(lx, segment.first.x);
+        ly = std::min(ly, segment.first.y);
+        hx = std::max(hx, segment.first.x);
+        hy = std::max(hy, segment.first.y);
+    }
+
+    // Around the polyline and well outside it.
+    std::uniform_real_distribution<float> x(lx - 20.0f, hx + 20.0f),
+        y(ly - 20.0f, hy + 20.0f);
+
+    BOOST_REQUIRE_EQUAL(index.Size(), segments.size());
+
+    for (int query = 0; query < 500; query++)
+    {
+        Vector2D point{x(rng), y(rng)}, other{x(rng), y(rng)};
+        float best_start = FLT_MAX, best_segment = FLT_MAX;
+
+        for (auto &segment : segments)
+        {
+            best_start =
+                std::min(best_start, point_distance(segment.first, point));
+            best_segment =
+                std::min(best_segment, segment_distance(segment, point));
+        }
+
+        int start = index.NearestStart(point);
+        int nearest = index.NearestSegment(point);
+        BOOST_REQUIRE_GE(start, 0);
+        BOOST_REQUIRE_GE(nearest, 0);
+        BOOST_REQUIRE_EQUAL(point_distance(segments[start].first, point),
+                            best_start);
+        BOOST_REQUIRE_EQUAL(segment_distance(segments[nearest], point),
+                            best_segment);
+
+        // Short and long query lines.
+        if (query % 2)
+            other = Vector2D{point.x + (other.x - point.x) / 20,
+                             point.y + (other.y - point.y) / 20};
+
+        std::vector<int> found;
+        index.Crossing(point, other, found);
+
+        BOOST_REQUIRE(std::is_sorted(found.begin(), found.end()));
+        for (size_t i = 0; i < segments.size(); i++)
+            if (crosses(segments[i], point, other))
+                BOOST_REQUIRE(std::binary_search(found.begin(), found.end(),
+                                                 (int)i));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(empty_index_finds_nothing)
+{
+    SegmentIndex index;
+    std::vector<int> found;
+
+    index.Refit({});
+    BOOST_CHECK_EQUAL(index.NearestStart(Vector2D{0.0f, 0.0f}), -1);
+    BOOST_CHECK_EQUAL(index.NearestSegment(Vector2D{0.0f, 0.0f}), -1);
+    index.Crossing(Vector2D{-1.0f, -1.0f}, Vector2D{1.0f, 1.0f}, found);
+    BOOST_CHECK(found.empty());
+}
+
+BOOST_AUTO_TEST_CASE(queries_match_brute_force)
+{
+    std::mt19937 rng(5);
+
+    // Fewer than a leaf, a whole number of leaves and leaves to spare.
+    for (size_t count : {1, 5, 8, 64, 100, 1000})
+    {
+        SegmentIndex index;
+        auto segments = polyline(rng, count);
+
+        index.Refit(segments);
+        check_against_brute_force(index, segments, rng);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(queries_match_brute_force_after_a_refit)
+{
+    std::mt19937 rng(9);
+    std::normal_distribution<float> nudge(0.0f, 0.5f);
+    SegmentIndex index;
+    auto segments = polyline(rng, 700);
+
+    index.Refit(segments);
+
+    // Moved in place, as relaxing the hinges does.
+    for (int round = 0; round < 3; round++)
+    {
+        for (auto &segment : segments)
+        {
+            segment.first.x += nudge(rng);
+            segment.first.y += nudge(rng);
+            segment.second.x += nudge(rng);
+            segment.second.y += nudge(rng);
+        }
+
+        index.Refit(segments);
+        check_against_brute_force(index, segments, rng);
+    }
+
+    // And a different count.
+    segments = polyline(rng, 300);
+    index.Refit(segments);
+    check_against_brute_force(index, segments, rng);
+}
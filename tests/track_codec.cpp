@@ -0,0 +1,142 @@
+#define BOOST_TEST_MODULE track_codec
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "track_codec.h"
+
+using Waypoint = HingyTrack::Waypoint;
+
+// What the XML tracks hold, millionths read back through atof.
+static float xml_value(float value)
+{
+    char text[64];
+    snprintf(text, sizeof(text), "%.6f", value);
+    return atof(text);
+}
+
+static std::vector<Waypoint> recorded_track(size_t count)
+{
+    std::mt19937 rng(11);
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+    std::vector<Waypoint> track;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        float l = 3.0f + std::sin(i / 50.0f) + noise(rng);
+        track.push_back(Waypoint{xml_value(0.2f + noise(rng) / 10),
+                                 xml_value(0.01f * std::sin(i / 30.0f)),
+                                 xml_value(l), xml_value(-l + 0.5f * noise(rng))});
+    }
+
+    return track;
+}
+
+static void check_round_trip(const std::vector<Waypoint> &track)
+{
+    std::vector<Waypoint> decoded;
+    auto data = encode_track(track);
+
+    BOOST_REQUIRE(decode_track(data.data(), data.size(), decoded));
+    BOOST_REQUIRE_EQUAL(decoded.size(), track.size());
+
+    for (size_t i = 0; i < track.size(); i++)
+    {
+        BOOST_REQUIRE_EQUAL(decoded[i].f, track[i].f);
+        BOOST_REQUIRE_EQUAL(decoded[i].a, track[i].a);
+        BOOST_REQUIRE_EQUAL(decoded[i].l, track[i].l);
+        BOOST_REQUIRE_EQUAL(decoded[i].r, track[i].r);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(tracks_come_back_exactly)
+{
+    // Partial blocks on either side of a whole one.
+    for (size_t count : {0, 1, 2, 127, 128, 129, 1000})
+        check_round_trip(recorded_track(count));
+}
+
+BOOST_AUTO_TEST_CASE(flat_and_jumping_fields_come_back_exactly)
+{
+    std::vector<Waypoint> track;
+
+    // Zero blocks, straight lines, then jumps big enough to be escaped.
+    for (int i = 0; i < 300; i++)
+        track.push_back(Waypoint{0.2f, 0.0f, xml_value(1.0f + i * 0.001f),
+                                 -1.0f});
+    for (int i = 0; i < 300; i++)
+        track.push_back(Waypoint{xml_value(i % 2 ? 1e5f : -1e5f), 0.0f,
+                                 xml_value(i * 37 % 1000 - 500.0f), 7.0f});
+
+    check_round_trip(track);
+}
+
+BOOST_AUTO_TEST_CASE(values_are_kept_to_millionths)
+{
+    std::vector<Waypoint> decoded;
+    std::vector<Waypoint> track{Waypoint{0.1234567f, -0.0000004f, 2.5f, -2.5f}};
+    auto data = encode_track(track);
+
+    BOOST_REQUIRE(decode_track(data.data(), data.size(), decoded));
+    BOOST_CHECK_EQUAL(decoded[0].f, xml_value(0.1234567f));
+    BOOST_CHECK_EQUAL(decoded[0].a, 0.0f);
+}
+
+BOOST_AUTO_TEST_CASE(smooth_tracks_compress)
+{
+    auto track = recorded_track(5000);
+    auto data = encode_track(track);
+
+    BOOST_CHECK_LT(data.size(), track.size() * sizeof(Waypoint) / 2);
+}
+
+BOOST_AUTO_TEST_CASE(malformed_data_is_rejected)
+{
+    std::vector<Waypoint> decoded;
+    auto data = encode_track(recorded_track(300));
+
+    // Cut anywhere, the data runs out before the last value.
+    for (size_t size = 0; size < data.size(); size++)
+    {
+        decoded.resize(1);
+        BOOST_REQUIRE(!decode_track(data.data(), size, decoded));
+        BOOST_REQUIRE(decoded.empty());
+    }
+
+    auto bad = data;
+    bad[0] ^= 1;
+    BOOST_CHECK(!decode_track(bad.data(), bad.size(), decoded));
+
+    bad = data;
+    TrackCodecHeader header;
+    memcpy(&header, bad.data(), sizeof(header));
+    header.version++;
+    memcpy(bad.data(), &header, sizeof(header));
+    BOOST_CHECK(!decode_track(bad.data(), bad.size(), decoded));
+
+    // More waypoints than the data could hold.
+    header.version = TRACK_CODEC_VERSION;
+    header.waypoints = UINT64_MAX / 2;
+    memcpy(bad.data(), &header, sizeof(header));
+    BOOST_CHECK(!decode_track(bad.data(), bad.size(), decoded));
+}
+
+BOOST_AUTO_TEST_CASE(garbage_does_not_crash)
+{
+    std::mt19937 rng(3);
+    std::vector<Waypoint> decoded;
+    auto data = encode_track(recorded_track(300));
+
+    for (int round = 0; round < 200; round++)
+    {
+        auto bad = data;
+        for (size_t i = sizeof(TrackCodecHeader); i < bad.size(); i++)
+            bad[i] = rng();
+
+        decode_track(bad.data(), bad.size(), decoded);
+        BOOST_REQUIRE(decoded.empty() || decoded.size() == 300);
+    }
+}
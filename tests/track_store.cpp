@@ -0,0 +1,191 @@
+#define BOOST_TEST_MODULE track_store
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "track_store.h"
+
+using std::string;
+
+#define IMAGE_BYTES 4096
+
+// A track file of its own, so the keys don't collide with anything else's.
+struct TrackFile
+{
+    string filename = "/tmp/track_store_test_" + std::to_string(getpid()) +
+                      ".xml";
+    stringmap params{{"track", filename},
+                     {"hinges_iterations", "10"},
+                     {"force1", "0.5"},
+                     {"force2", "0.25"},
+                     {"hinges_tolerance", "1e-4"},
+                     {"sa", "1"},
+                     {"sb", "2"},
+                     {"sc", "3"}};
+
+    TrackFile()
+    {
+        FILE *f = fopen(filename.c_str(), "w");
+        fprintf(f, "<track pid=\"%d\"/>\n", getpid());
+        fclose(f);
+    }
+
+    ~TrackFile()
+    {
+        shm_unlink(TrackStore::Key(params).c_str());
+        remove(filename.c_str());
+    }
+};
+
+static TrackStoreHeader *fill(TrackStoreHeader *header)
+{
+    header->bytes = IMAGE_BYTES;
+    header->hinge_sep = 13.0f;
+    memset(header + 1, 0x5a, IMAGE_BYTES - sizeof(*header));
+    return header;
+}
+
+static bool filled(const TrackStoreHeader *header)
+{
+    auto bytes = (const uint8_t *)(header + 1);
+    for (size_t i = 0; i < IMAGE_BYTES - sizeof(*header); i++)
+        if (bytes[i] != 0x5a)
+            return false;
+    return header->hinge_sep == 13.0f;
+}
+
+// A process id nothing runs under any more.
+static pid_t dead_pid()
+{
+    pid_t pid = fork();
+    if (pid == 0)
+        _exit(0);
+    waitpid(pid, NULL, 0);
+    return pid;
+}
+
+BOOST_FIXTURE_TEST_SUITE(track_store, TrackFile)
+
+BOOST_AUTO_TEST_CASE(keys_follow_what_shapes_the_track)
+{
+    string key = TrackStore::Key(params);
+
+    BOOST_CHECK_EQUAL(key.compare(0, 7, "/hingy_"), 0);
+    BOOST_CHECK_EQUAL(key, TrackStore::Key(params));
+
+    auto same = params;
+    same["force1"] = "0.50";
+    BOOST_CHECK_EQUAL(TrackStore::Key(same), key);
+
+    for (auto name : {"hinges_iterations", "force1", "force2",
+                      "hinges_tolerance", "sa", "sb", "sc"})
+    {
+        auto changed = params;
+        changed[name] = "7";
+        BOOST_CHECK_NE(TrackStore::Key(changed), key);
+    }
+
+    // The unrelated ones don't matter.
+    auto unrelated = params;
+    unrelated["port"] = "3002";
+    BOOST_CHECK_EQUAL(TrackStore::Key(unrelated), key);
+
+    auto missing = params;
+    missing["track"] = "/nonexistent.xml";
+    BOOST_CHECK_EQUAL(TrackStore::Key(missing), "");
+}
+
+BOOST_AUTO_TEST_CASE(published_segments_are_attached)
+{
+    string key = TrackStore::Key(params);
+    shm_unlink(key.c_str());
+
+    auto header = TrackStore::Create(key, IMAGE_BYTES);
+    BOOST_REQUIRE(header);
+    BOOST_CHECK_EQUAL(header->publisher, getpid());
+
+    // Not while it's written, nor by a second publisher.
+    BOOST_CHECK(!TrackStore::Attach(key));
+    BOOST_CHECK(!TrackStore::Create(key, IMAGE_BYTES));
+
+    TrackStore::Seal(fill(header));
+
+    auto attached = TrackStore::Attach(key);
+    BOOST_REQUIRE(attached);
+    BOOST_CHECK(filled(attached.get()));
+    BOOST_CHECK(!TrackStore::Create(key, IMAGE_BYTES));
+}
+
+BOOST_AUTO_TEST_CASE(abandoned_segments_are_taken_over)
+{
+    string key = TrackStore::Key(params);
+    shm_unlink(key.c_str());
+
+    auto header = TrackStore::Create(key, IMAGE_BYTES);
+    BOOST_REQUIRE(header);
+    header->publisher = dead_pid();
+    munmap(header, IMAGE_BYTES);
+
+    header = TrackStore::Create(key, IMAGE_BYTES);
+    BOOST_REQUIRE(header);
+    BOOST_CHECK_EQUAL(header->publisher, getpid());
+
+    // Complete, but from another version.
+    fill(header);
+    header->magic = TRACK_STORE_MAGIC;
+    header->version = TRACK_STORE_VERSION - 1;
+    header->ready.store(1);
+    munmap(header, IMAGE_BYTES);
+
+    BOOST_CHECK(!TrackStore::Attach(key));
+    header = TrackStore::Create(key, IMAGE_BYTES);
+    BOOST_REQUIRE(header);
+    TrackStore::Seal(fill(header));
+    BOOST_CHECK(TrackStore::Attach(key));
+}
+
+BOOST_AUTO_TEST_CASE(purge_removes_segments)
+{
+    string key = TrackStore::Key(params);
+    shm_unlink(key.c_str());
+
+    auto header = TrackStore::Create(key, IMAGE_BYTES);
+    BOOST_REQUIRE(header);
+    TrackStore::Seal(fill(header));
+    auto attached = TrackStore::Attach(key);
+
+    BOOST_CHECK_GE(TrackStore::Purge(), 1);
+    BOOST_CHECK(!TrackStore::Attach(key));
+
+    // Those mapped already stay.
+    BOOST_CHECK(filled(attached.get()));
+}
+
+BOOST_AUTO_TEST_CASE(saved_images_load_back)
+{
+    string artifact = filename + ".hprep";
+    std::vector<uint64_t> image(IMAGE_BYTES / sizeof(uint64_t));
+    auto header = fill(new (image.data()) TrackStoreHeader());
+    header->publisher = getpid();
+
+    BOOST_REQUIRE(TrackStore::Save(artifact, header));
+
+    auto loaded = TrackStore::Load(artifact);
+    BOOST_REQUIRE(loaded);
+    BOOST_CHECK(filled(loaded.get()));
+    BOOST_CHECK_EQUAL(loaded->publisher, 0);
+
+    // Cut short, it isn't trusted.
+    BOOST_REQUIRE_EQUAL(truncate(artifact.c_str(), IMAGE_BYTES / 2), 0);
+    BOOST_CHECK(!TrackStore::Load(artifact));
+
+    BOOST_CHECK(!TrackStore::Load("/nonexistent.hprep"));
+    remove(artifact.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
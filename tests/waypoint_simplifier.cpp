@@ -0,0 +1,159 @@
+#define BOOST_TEST_MODULE waypoint_simplifier
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <cmath>
+#include <random>
+
+#include "waypoint_simplifier.h"
+
+using Waypoint = HingyTrack::Waypoint;
+
+#define FORWARD_FACTOR 0.40f
+#define ANGLE_FACTOR 0.1965f
+
+struct Point
+{
+    float x, y;
+};
+
+// Straights, gentle curves and a hairpin, with some jitter on the turns.
+static std::vector<Waypoint> recorded_path()
+{
+    std::mt19937 rng(7);
+    std::normal_distribution<float> jitter(0.0f, 0.002f);
+    std::vector<Waypoint> path;
+
+    for (int i = 0; i < 6000; i++)
+    {
+        float turn = i < 1000 ? 0.0f : 0.05f * std::sin(i / 200.0f);
+        if (i >= 4000 && i < 4100)
+            turn = 0.6f;
+
+        path.push_back(Waypoint{0.2f, turn + jitter(rng), 0.3f, -0.3f});
+    }
+
+    return path;
+}
+
+// Where the path is after each waypoint, integrated as ConstructBounds does.
+static std::vector<Point> integrate(const std::vector<Waypoint> &path,
+                                    std::vector<float> *headings = nullptr)
+{
+    std::vector<Point> points{Point{0.0f, 0.0f}};
+    float heading = 0.0f;
+
+    for (auto &waypoint : path)
+    {
+        if (headings)
+            headings->push_back(heading);
+
+        points.push_back(Point{
+            points.back().x + std::cos(heading) * FORWARD_FACTOR * waypoint.f,
+            points.back().y + std::sin(heading) * FORWARD_FACTOR * waypoint.f});
+        heading += waypoint.a * ANGLE_FACTOR;
+    }
+
+    if (headings)
+        headings->push_back(heading);
+
+    return points;
+}
+
+static float segment_distance(Point a, Point b, Point point)
+{
+    float ex = b.x - a.x, ey = b.y - a.y, length = ex * ex + ey * ey;
+    float t = length > 0.0f
+                  ? ((point.x - a.x) * ex + (point.y - a.y) * ey) / length
+                  : 0.0f;
+    t = std::min(std::max(t, 0.0f), 1.0f);
+
+    return std::hypot(a.x + t * ex - point.x, a.y + t * ey - point.y);
+}
+
+static std::vector<Waypoint> simplify(const std::vector<Waypoint> &path,
+                                      float tolerance)
+{
+    WaypointSimplifier simplifier(tolerance, FORWARD_FACTOR, ANGLE_FACTOR);
+    std::vector<Waypoint> out;
+
+    for (auto &waypoint : path)
+        simplifier.Add(waypoint, out);
+    simplifier.Flush(out);
+
+    return out;
+}
+
+BOOST_AUTO_TEST_CASE(zero_tolerance_passes_through)
+{
+    auto path = recorded_path();
+    auto out = simplify(path, 0.0f);
+
+    BOOST_REQUIRE_EQUAL(out.size(), path.size());
+    for (size_t i = 0; i < path.size(); i++)
+    {
+        BOOST_CHECK_EQUAL(out[i].f, path[i].f);
+        BOOST_CHECK_EQUAL(out[i].a, path[i].a);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(runs_stay_within_tolerance_of_their_chords)
+{
+    auto path = recorded_path();
+    auto points = integrate(path);
+
+    for (float tolerance : {0.01f, 0.05f, 0.2f})
+    {
+        auto out = simplify(path, tolerance);
+        std::vector<float> headings;
+        integrate(out, &headings);
+
+        BOOST_CHECK_LT(out.size(), path.size() / 4);
+        BOOST_CHECK_EQUAL(out[0].f, path[0].f);
+
+        // Each merged waypoint stands for the run of recorded ones its
+        // odometer length adds up to, from where the previous one ended.
+        size_t start = 1;
+        for (size_t j = 1; j < out.size(); j++)
+        {
+            size_t end = start;
+            float length = 0.0f;
+
+            while (end < path.size() && length < out[j].f - 1e-4f)
+                length += path[end++].f;
+
+            BOOST_REQUIRE_CLOSE(length, out[j].f, 1e-3);
+            BOOST_REQUIRE_LE(length, SIMPLIFY_MAX_RUN + 1e-4f);
+
+            Point anchor = points[start], chord_end = points[end];
+            for (size_t k = start + 1; k < end; k++)
+                BOOST_REQUIRE_LE(segment_distance(anchor, chord_end, points[k]),
+                                 tolerance * 1.001f);
+
+            // The merged path heads along the chord.
+            float chord = std::atan2(chord_end.y - anchor.y,
+                                     chord_end.x - anchor.x);
+            BOOST_REQUIRE_SMALL(std::remainder(headings[j] - chord, 2 * M_PI),
+                                1e-3);
+
+            BOOST_CHECK_CLOSE(out[j].l, 0.3f, 1e-3);
+            start = end;
+        }
+
+        BOOST_CHECK_EQUAL(start, path.size());
+
+        // And ends the way the recording did.
+        std::vector<float> recorded;
+        integrate(path, &recorded);
+        BOOST_CHECK_SMALL(
+            std::remainder(headings.back() - recorded.back(), 2 * M_PI), 1e-3);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(tighter_tolerance_keeps_more_waypoints)
+{
+    auto path = recorded_path();
+
+    BOOST_CHECK_GT(simplify(path, 0.01f).size(), simplify(path, 0.05f).size());
+    BOOST_CHECK_GT(simplify(path, 0.05f).size(), simplify(path, 0.2f).size());
+}